@@ -12,6 +12,7 @@
 #include "lcd_i2c.h"
 #include "lcd_constants.h"
 #include <stdbool.h>
+#include <string.h>
 
 #define DELAY_US(us) Delay_Us(us)  
 #define DELAY_MS(ms) Delay_Ms(ms) 
@@ -19,10 +20,45 @@
 // I2C Timeout count
 #define TIMEOUT_MAX 100000
 
+// Bytes LCD_Send() puts on the bus after the address: register + 4 nibbles
+#define LCD_SEND_BYTES 5
+
+// Streamed writes pack the 4 EN-toggled nibble bytes of many commands or
+// characters into one I2C transaction, with no delays between them. The
+// PCF8574 outputs change at each byte's ACK, so the first nibble of the
+// next character is latched 2 bytes (18 SCL clocks) after the last one:
+// 45us at 400kHz, the fastest rate lib_i2c sets, against the 41us an
+// HD44780 needs per character or cursor move. Sized for a full row plus a
+// cursor move.
+// Streams go out with i2c_write_async(), double buffered so the next one
+// can be packed while the last is still on the bus.
+#define LCD_STREAM_BYTES ((LCD_COLS + 2) * 4)
+
+/*** Private Variables *******************************************************/
+static const uint8_t row_offsets[] = {0x00, 0x40, 0x14, 0x54};
+
+static char lcd_frame[LCD_ROWS][LCD_COLS];  // what the LCD_Frame* calls drew
+static char lcd_shown[LCD_ROWS][LCD_COLS];  // what the display is showing
+static bool lcd_shown_valid = false;        // false forces a full redraw
+static volatile bool lcd_bus_failed = false; // a transfer failed, lcd_shown can't be trusted
+static uint8_t frame_col = 0;
+static uint8_t frame_row = 0;
+static uint8_t lcd_ddram_addr = 0xFF;       // display address counter, 0xFF if unknown
+static uint16_t lcd_i2c_bytes = 0;          // running count of bytes sent
+static uint8_t lcd_stream[2][LCD_STREAM_BYTES];
+static uint8_t lcd_stream_sel = 0;
+static uint8_t lcd_stream_len = 0;
+static LCD_FlushStats flush_stats;
+
 /*** Private Functions *******************************************************/
 static void LCD_Send(uint8_t address, uint8_t data, uint8_t mode);
+static void LCD_Pack(uint8_t *buf, uint8_t data, uint8_t mode);
+static void LCD_StreamPut(uint8_t address, uint8_t data, uint8_t mode);
+static void LCD_StreamEnd(uint8_t address);
+static void LCD_StreamDone(const i2c_err_t status);
 static uint8_t check_event(uint32_t event_mask);
 static uint8_t i2c_error_handler(const char *error_message);
+static void LCD_ResetShadow(void);
 
 /*** Public Functions ********************************************************/
 
@@ -55,6 +91,7 @@ void LCD_Init(uint8_t address, uint32_t clk_rate) {
     
     LCD_SetBacklight(address, 1);  // Turn on backlight
     DELAY_MS(2);
+    LCD_ResetShadow();
 }
 /**
  * @brief Writes a command to the LCD.
@@ -64,6 +101,7 @@ void LCD_Init(uint8_t address, uint32_t clk_rate) {
 void LCD_WriteCommand(uint8_t address, uint8_t command) {
     LCD_Send(address, command, 0);
     DELAY_US(37);  // Command execution time
+    lcd_ddram_addr = 0xFF;  // may have moved, callers that know set it again
 }
 
 /**
@@ -74,6 +112,8 @@ void LCD_WriteCommand(uint8_t address, uint8_t command) {
 void LCD_WriteData(uint8_t address, uint8_t data) {
     LCD_Send(address, data, 1);
     DELAY_US(41);  // Data write time
+    lcd_shown_valid = false;  // written behind the shadow's back
+    lcd_ddram_addr = 0xFF;
 }
 /**
  * @brief Writes a string to the LCD.
@@ -83,8 +123,11 @@ void LCD_WriteData(uint8_t address, uint8_t data) {
 
 void LCD_WriteString(uint8_t address, const char* str) {
     while (*str) {
-        LCD_WriteData(address, *str++);
+        LCD_StreamPut(address, *str++, 1);
     }
+    LCD_StreamEnd(address);
+    lcd_shown_valid = false;  // written behind the shadow's back
+    lcd_ddram_addr = 0xFF;
 }
 
 void LCD_WriteChar(uint8_t address, char c) {
@@ -97,9 +140,9 @@ void LCD_WriteChar(uint8_t address, char c) {
  * @param row Row number (0-based).
  */
 void LCD_SetCursor(uint8_t address, uint8_t col, uint8_t row) {
-    static const uint8_t row_offsets[] = {0x00, 0x40, 0x14, 0x54};
     uint8_t position = row_offsets[row] + col;
     LCD_WriteCommand(address, HD44780_SET_DDRRAM_ADDR | position);
+    lcd_ddram_addr = position;
 }
 
 /**
@@ -109,6 +152,7 @@ void LCD_SetCursor(uint8_t address, uint8_t col, uint8_t row) {
 void LCD_Clear(uint8_t address) {
     LCD_WriteCommand(address, HD44780_CLEAR_DISPLAY);
     DELAY_MS(2);  // Clear display requires more time
+    LCD_ResetShadow();
 }
 /**
  * @brief Clears a single line on the LCD.
@@ -117,9 +161,12 @@ void LCD_Clear(uint8_t address) {
  */
 void LCD_ClearLine(uint8_t address, uint8_t row) {
     LCD_SetCursor(address, 0, row);
-    for(uint8_t i = 0; i < 20; i++) {  // Assumes 20 column display
-        LCD_WriteData(address, ' ');
+    for(uint8_t i = 0; i < LCD_COLS; i++) {
+        LCD_StreamPut(address, ' ', 1);
     }
+    LCD_StreamEnd(address);
+    lcd_shown_valid = false;
+    lcd_ddram_addr = 0xFF;
 }
 /**
  * @brief Prints a string centered on the LCD.
@@ -208,8 +255,116 @@ void LCD_SetBacklight(uint8_t address, uint8_t state) {
     }
 }
 
+/**
+ * @brief Fills the frame with spaces and homes the frame cursor. No I2C traffic.
+ */
+void LCD_FrameClear(void) {
+    memset(lcd_frame, ' ', sizeof(lcd_frame));
+    frame_col = 0;
+    frame_row = 0;
+}
+
+/**
+ * @brief Moves the frame cursor.
+ * @param col Column number (0-based).
+ * @param row Row number (0-based).
+ */
+void LCD_FrameSetCursor(uint8_t col, uint8_t row) {
+    frame_col = col;
+    frame_row = row;
+}
+
+/**
+ * @brief Draws a character at the frame cursor. Characters past the end of
+ * the row are dropped.
+ * @param c Character to draw.
+ */
+void LCD_FrameWriteChar(char c) {
+    if (frame_row < LCD_ROWS && frame_col < LCD_COLS) {
+        lcd_frame[frame_row][frame_col++] = c;
+    }
+}
+
+/**
+ * @brief Draws a string at the frame cursor.
+ * @param str Null-terminated string to draw.
+ */
+void LCD_FrameWriteString(const char* str) {
+    while (*str) {
+        LCD_FrameWriteChar(*str++);
+    }
+}
+
+/**
+ * @brief Sends the cells that differ from the display.
+ * @param address I2C address of the LCD.
+ * @return I2C bytes sent.
+ */
+uint16_t LCD_Flush(uint8_t address) {
+    // Rows in DDRAM address order, the end of row 0 runs on into row 2 and
+    // the end of row 1 into row 3, so a run can continue without a command
+    static const uint8_t row_order[LCD_ROWS] = {0, 2, 1, 3};
+    uint16_t start_bytes = lcd_i2c_bytes;
+
+    // The shadow marks cells shown before their stream is on the bus. If
+    // one failed since, the display is behind, so redraw all of it
+    if (lcd_bus_failed) {
+        lcd_bus_failed = false;
+        lcd_shown_valid = false;
+        lcd_ddram_addr = 0xFF;
+    }
+
+    flush_stats.cells = 0;
+    flush_stats.commands = 0;
+
+    for (uint8_t i = 0; i < LCD_ROWS; i++) {
+        uint8_t row = row_order[i];
+        for (uint8_t col = 0; col < LCD_COLS; col++) {
+            char c = lcd_frame[row][col];
+            if (lcd_shown_valid && lcd_shown[row][col] == c) {
+                continue;
+            }
+
+            // Only move the address counter when the run breaks
+            uint8_t position = row_offsets[row] + col;
+            if (position != lcd_ddram_addr) {
+                LCD_StreamPut(address, HD44780_SET_DDRRAM_ADDR | position, 0);
+                flush_stats.commands++;
+            }
+            LCD_StreamPut(address, c, 1);
+            flush_stats.cells++;
+
+            lcd_ddram_addr = position + 1;
+            lcd_shown[row][col] = c;
+        }
+    }
+
+    LCD_StreamEnd(address);
+
+    lcd_shown_valid = true;
+    flush_stats.i2c_bytes = lcd_i2c_bytes - start_bytes;
+    return flush_stats.i2c_bytes;
+}
+
+/**
+ * @brief Returns the counters of the last LCD_Flush().
+ */
+const LCD_FlushStats* LCD_GetFlushStats(void) {
+    return &flush_stats;
+}
+
 /*** Private Functions *******************************************************/
 
+/**
+ * @brief Marks the display as blank with the address counter at 0, as it is
+ * after a clear.
+ */
+static void LCD_ResetShadow(void) {
+    memset(lcd_shown, ' ', sizeof(lcd_shown));
+    lcd_shown_valid = true;
+    lcd_ddram_addr = 0;
+}
+
 /**
  * @brief Sends a command or data to the LCD.
  * @param address I2C address of the LCD.
@@ -217,21 +372,83 @@ void LCD_SetBacklight(uint8_t address, uint8_t state) {
  * @param mode Mode (0 for command, 1 for data).
  */
 static void LCD_Send(uint8_t address, uint8_t data, uint8_t mode) {
+    uint8_t buf[4];
+    LCD_Pack(buf, data, mode);
+
+    if (i2c_write(address, 0x00, buf, 4) != I2C_OK) {
+        i2c_error_handler("Failed to send data to LCD");
+    }
+    lcd_i2c_bytes += LCD_SEND_BYTES;
+}
+
+/**
+ * @brief Builds the 4 PCF8574 bytes that clock one byte into the LCD.
+ * @param buf Output, 4 bytes.
+ * @param data Data byte to send.
+ * @param mode Mode (0 for command, 1 for data).
+ */
+static void LCD_Pack(uint8_t *buf, uint8_t data, uint8_t mode) {
     uint8_t high_nibble = (data & 0xF0) | (mode ? 0x01 : 0x00) | 0x04 | 0x08;  // Include backlight
     uint8_t low_nibble = ((data << 4) & 0xF0) | (mode ? 0x01 : 0x00) | 0x04 | 0x08;
-    
-    // Send high nibble
-    uint8_t buf[3];
+
+    // High nibble
     buf[0] = high_nibble;
     buf[1] = high_nibble & ~0x04;  // Toggle EN low
-    
-    // Send low nibble
+
+    // Low nibble
     buf[2] = low_nibble;
     buf[3] = low_nibble & ~0x04;   // Toggle EN low
-    
-    if (i2c_write(address, 0x00, buf, 4) != I2C_OK) {
+}
+
+/**
+ * @brief Appends a command or data byte to the stream, sending the stream
+ * first if it is full.
+ * @param address I2C address of the LCD.
+ * @param data Data byte to send.
+ * @param mode Mode (0 for command, 1 for data).
+ */
+static void LCD_StreamPut(uint8_t address, uint8_t data, uint8_t mode) {
+    if (lcd_stream_len + 4 > LCD_STREAM_BYTES) {
+        LCD_StreamEnd(address);
+    }
+    LCD_Pack(&lcd_stream[lcd_stream_sel][lcd_stream_len], data, mode);
+    lcd_stream_len += 4;
+}
+
+/**
+ * @brief Starts sending the stream as one I2C transaction and switches to
+ * the other buffer. Returns before the bytes are on the bus.
+ * @param address I2C address of the LCD.
+ */
+static void LCD_StreamEnd(uint8_t address) {
+    if (lcd_stream_len == 0) {
+        return;
+    }
+
+    // Report a failure of the previous stream before reusing the bus
+    if (i2c_async_wait() != I2C_OK) {
+        i2c_error_handler("Failed to send data to LCD");
+    }
+
+    // The PCF8574 has no register, so the first byte goes where
+    // i2c_write() puts the register byte
+    uint8_t *stream = lcd_stream[lcd_stream_sel];
+    if (i2c_write_async(address, stream[0], &stream[1], lcd_stream_len - 1, LCD_StreamDone) != I2C_OK) {
         i2c_error_handler("Failed to send data to LCD");
     }
+    lcd_i2c_bytes += lcd_stream_len;
+    lcd_stream_sel ^= 1;
+    lcd_stream_len = 0;
+}
+
+/**
+ * @brief Completion callback of a stream, from interrupt context.
+ * @param status Result of the transfer.
+ */
+static void LCD_StreamDone(const i2c_err_t status) {
+    if (status != I2C_OK) {
+        lcd_bus_failed = true;
+    }
 }
 /**
  * @brief Checks for a specific I2C event.
@@ -250,7 +467,7 @@ static uint8_t check_event(uint32_t event_mask) {
  */
 static uint8_t i2c_error_handler(const char *error_message) {
     printf("I2C Error: %s\n", error_message);
-    RCC->APB1PRSTR |= RCC_APB1Periph_I2C1;  // Reset I2C peripheral
-    RCC->APB1PRSTR &= ~RCC_APB1Periph_I2C1;
+    lcd_bus_failed = true;  // the next LCD_Flush() redraws everything
+    i2c_bus_recover();  // Free the bus and reset the I2C peripheral
     return 1;
 }
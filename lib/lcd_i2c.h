@@ -6,6 +6,20 @@
 #include "lib_i2c.h"
 #include "ch32v003fun.h"
 #include <stdbool.h>
+
+// Display geometry, the shadow framebuffer is sized from these
+#define LCD_COLS 20
+#define LCD_ROWS 4
+
+/**
+ * @brief Counters for the last LCD_Flush().
+ */
+typedef struct {
+    uint16_t i2c_bytes;   // bytes sent over I2C, excluding address bytes
+    uint8_t cells;        // character cells written
+    uint8_t commands;     // SET_DDRRAM_ADDR commands sent
+} LCD_FlushStats;
+
 /**
  * @brief Initializes the LCD over I2C.
  * @param address I2C address of the LCD.
@@ -81,4 +95,48 @@ void LCD_ScrollText(uint8_t address, const char* text, uint8_t row, uint16_t del
  */
 void LCD_SetBacklight(uint8_t address, uint8_t state);
 
+/*
+ * Shadow framebuffer. The LCD_Frame* calls only draw into RAM, LCD_Flush()
+ * then compares against what the display already shows and sends just the
+ * changed runs of cells. The immediate calls above still work, but mixing
+ * them in makes the next flush redraw everything.
+ */
+
+/**
+ * @brief Fills the frame with spaces and homes the frame cursor. No I2C traffic.
+ */
+void LCD_FrameClear(void);
+
+/**
+ * @brief Moves the frame cursor.
+ * @param col Column number (0-based).
+ * @param row Row number (0-based).
+ */
+void LCD_FrameSetCursor(uint8_t col, uint8_t row);
+
+/**
+ * @brief Draws a character at the frame cursor. Characters past the end of
+ * the row are dropped.
+ * @param c Character to draw.
+ */
+void LCD_FrameWriteChar(char c);
+
+/**
+ * @brief Draws a string at the frame cursor.
+ * @param str Null-terminated string to draw.
+ */
+void LCD_FrameWriteString(const char* str);
+
+/**
+ * @brief Sends the cells that differ from the display.
+ * @param address I2C address of the LCD.
+ * @return I2C bytes sent.
+ */
+uint16_t LCD_Flush(uint8_t address);
+
+/**
+ * @brief Returns the counters of the last LCD_Flush().
+ */
+const LCD_FlushStats* LCD_GetFlushStats(void);
+
 #endif 
@@ -77,6 +77,230 @@ static inline uint32_t i2c_get_busy_error(void)
 	return i2c_err;
 }
 
+/// @brief Waits for an I2C status to match, giving up after I2C_TIMEOUT polls
+/// @param status_mask, status bits to wait for
+/// @return i2c_err_t. I2C_OK once matched, else the bus error or I2C_ERR_BUSY
+static i2c_err_t i2c_wait(const uint32_t status_mask)
+{
+	int32_t timeout = I2C_TIMEOUT;
+	while(!i2c_status(status_mask))
+		if(--timeout < 0) return i2c_get_busy_error();
+	return I2C_OK;
+}
+
+/// @brief Waits for a STAR1 flag only. Unlike i2c_wait() it does not read
+/// STAR2, so a pending ADDR stays set. Gives up early on a NACK or bus error
+/// @param flag, STAR1 bit to wait for
+/// @return i2c_err_t. I2C_OK once set, else the bus error or I2C_ERR_BUSY
+static i2c_err_t i2c_wait_flag(const uint16_t flag)
+{
+	int32_t timeout = I2C_TIMEOUT;
+	while(!(I2C1->STAR1 & flag))
+	{
+		if(I2C1->STAR1 & (I2C_STAR1_AF | I2C_STAR1_BERR | I2C_STAR1_ARLO)) return i2c_error();
+		if(--timeout < 0) return i2c_get_busy_error();
+	}
+	return I2C_OK;
+}
+
+/// @brief Waits for the bus to go idle, then sends a START and the address.
+/// A read returns with ADDR still set, so the caller can set up ACK, POS
+/// and DMA before the first byte is clocked in
+/// @param addr, 7 Bit address of the device
+/// @param read, 1 for a read address, 0 for a write address
+/// @return i2c_err_t. I2C_OK once the device has ACKed its address
+static i2c_err_t i2c_start(const uint8_t addr, const uint8_t read)
+{
+	i2c_err_t i2c_ret = I2C_OK;
+
+	// Wait for the bus to become not busy - set state to I2C_ERR_BUSY on failure.
+	// A repeated START is sent while we still own the bus, skip the wait
+	int32_t timeout = I2C_TIMEOUT;
+	while(!(I2C1->STAR2 & I2C_STAR2_MSL) && (I2C1->STAR2 & I2C_STAR2_BUSY)) 
+		if(--timeout < 0) return i2c_get_busy_error();
+
+	// Send a START Signal and wait for it to assert
+	I2C1->CTLR1 |= I2C_CTLR1_START;
+	if((i2c_ret = i2c_wait(I2C_EVENT_MASTER_MODE_SELECT)) != I2C_OK) return i2c_ret;
+
+	// Send the Address and wait for it to finish transmitting
+	if(read)
+	{
+		I2C1->DATAR = (addr << 1) | 0x01;
+		return i2c_wait_flag(I2C_STAR1_ADDR);
+	}
+	I2C1->DATAR = (addr << 1) & 0xFE;
+	return i2c_wait(I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED);
+}
+
+
+
+/// @brief Reads [len] bytes once the read address is ACKed, ADDR still set.
+/// Follows the reference manual sequences, so the last byte gets a NACK and
+/// the STOP goes out before the slave can start another byte
+/// @param buf, buffer to read to
+/// @param len, number of bytes to read, at least 1
+/// @return i2c_err_t. I2C_OK on Success, the STOP has been sent
+static i2c_err_t i2c_read_burst(uint8_t *buf, const uint8_t len)
+{
+	i2c_err_t i2c_ret;
+
+	// 1 Byte: ACK is already off, clear ADDR then STOP straight away
+	if(len == 1)
+	{
+		(void)I2C1->STAR2;
+		I2C1->CTLR1 |= I2C_CTLR1_STOP;
+		if((i2c_ret = i2c_wait_flag(I2C_STAR1_RXNE)) != I2C_OK) return i2c_ret;
+		buf[0] = I2C1->DATAR;
+		return I2C_OK;
+	}
+
+	(void)I2C1->STAR2;
+
+	// 2 Bytes: with POS set, clearing ACK NACKs the byte after the one in
+	// the shift register. Both are in once BTF sets
+	if(len == 2)
+	{
+		I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
+		if((i2c_ret = i2c_wait_flag(I2C_STAR1_BTF)) != I2C_OK) return i2c_ret;
+		I2C1->CTLR1 |= I2C_CTLR1_STOP;
+		buf[0] = I2C1->DATAR;
+		buf[1] = I2C1->DATAR;
+		return I2C_OK;
+	}
+
+	// N Bytes: ACK everything up to the last 3
+	uint8_t cbyte = 0;
+	while(len - cbyte > 3)
+	{
+		if((i2c_ret = i2c_wait_flag(I2C_STAR1_RXNE)) != I2C_OK) return i2c_ret;
+		buf[cbyte++] = I2C1->DATAR;
+	}
+
+	// BTF: N-2 is in DATAR, N-1 in the shift register and SCL is held low.
+	// Clear ACK now so byte N gets the NACK
+	if((i2c_ret = i2c_wait_flag(I2C_STAR1_BTF)) != I2C_OK) return i2c_ret;
+	I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
+	buf[cbyte++] = I2C1->DATAR;
+	I2C1->CTLR1 |= I2C_CTLR1_STOP;
+	buf[cbyte++] = I2C1->DATAR;
+
+	if((i2c_ret = i2c_wait_flag(I2C_STAR1_RXNE)) != I2C_OK) return i2c_ret;
+	buf[cbyte] = I2C1->DATAR;
+	return I2C_OK;
+}
+
+/// @brief Reads [len] bytes over DMA1 Channel 7 once the read address is
+/// ACKed, ADDR still set. With LAST set the I2C NACKs the final byte itself
+/// @param buf, buffer to read to
+/// @param len, number of bytes to read, at least 2
+/// @return i2c_err_t. I2C_OK on Success, the STOP has been sent
+static i2c_err_t i2c_read_dma(uint8_t *buf, const uint8_t len)
+{
+	i2c_err_t i2c_ret = I2C_OK;
+
+	DMA1_Channel7->MADDR = (uint32_t)buf;
+	DMA1_Channel7->CNTR = len;
+	DMA1_Channel7->CFGR = DMA_CFGR1_MINC | DMA_CFGR1_EN;
+	I2C1->CTLR2 |= I2C_CTLR2_DMAEN | I2C_CTLR2_LAST;
+	(void)I2C1->STAR2;
+
+	// The timeout restarts with every byte, so any length is fine
+	uint32_t remaining = len;
+	int32_t timeout = I2C_TIMEOUT;
+	while(!(DMA1->INTFR & DMA1_FLAG_TC7))
+	{
+		if(DMA1_Channel7->CNTR != remaining) {remaining = DMA1_Channel7->CNTR; timeout = I2C_TIMEOUT;}
+		if((i2c_ret = i2c_error()) != I2C_OK) break;
+		if(--timeout < 0) {i2c_ret = I2C_ERR_BUSY; break;}
+	}
+	if(i2c_ret == I2C_OK) I2C1->CTLR1 |= I2C_CTLR1_STOP;
+
+	DMA1_Channel7->CFGR &= ~DMA_CFGR1_EN;
+	DMA1->INTFCR = DMA1_IT_GL7;
+	I2C1->CTLR2 &= ~(I2C_CTLR2_DMAEN | I2C_CTLR2_LAST);
+	return i2c_ret;
+}
+
+
+
+/*** Transaction Queue State *************************************************/
+// Interrupt enables used while the queue owns the bus
+#define I2C_IT_ALL (I2C_CTLR2_ITEVTEN | I2C_CTLR2_ITBUFEN | I2C_CTLR2_ITERREN)
+
+// Phase timeout in SysTick ticks
+#define I2C_PHASE_TICKS (I2C_PHASE_TIMEOUT_US * DELAY_US_TIME)
+
+typedef enum {
+	XFER_IDLE = 0,
+	XFER_START,			// START sent, waiting for SB
+	XFER_ADDR,			// write address sent, waiting for ADDR
+	XFER_REG,			// register byte sent, waiting for TXE
+	XFER_WRITE,			// DMA sending the data, waiting for BTF
+	XFER_RESTART,		// repeated START sent, waiting for SB
+	XFER_READ_ADDR,		// read address sent, waiting for ADDR
+	XFER_READ,			// receiving a single byte, waiting for RXNE
+	XFER_READ_DMA,		// DMA receiving, waiting for its transfer complete
+} xfer_state_t;
+
+static i2c_xfer_t xfer_queue[I2C_QUEUE_LEN];
+static volatile uint8_t queue_head = 0;		// running entry, moved on by the ISR
+static volatile uint8_t queue_tail = 0;		// next free entry, moved on by submit
+static volatile xfer_state_t xfer_state = XFER_IDLE;
+static volatile uint32_t phase_start;		// SysTick->CNT when the phase began
+static volatile i2c_err_t last_status = I2C_OK;
+
+// Saved by i2c_init() so i2c_bus_recover() can restore them after a reset
+static uint16_t saved_ctlr2;
+static uint16_t saved_ckcfgr;
+
+/// @brief Moves the running transfer to a new phase and restarts its timeout
+/// @param state, the new phase
+/// @return None
+__attribute__((always_inline))
+static inline void xfer_phase(const xfer_state_t state)
+{
+	xfer_state = state;
+	phase_start = SysTick->CNT;
+}
+
+/// @brief Starts the transfer at the head of the queue, if any. Call with
+/// interrupts off, or from the I2C interrupts
+/// @param None
+/// @return None
+static void xfer_begin(void)
+{
+	if(queue_head == queue_tail) {xfer_state = XFER_IDLE; return;}
+
+	// Let a STOP from the last transfer go out first
+	int32_t timeout = I2C_TIMEOUT;
+	while(I2C1->CTLR1 & I2C_CTLR1_STOP)
+		if(--timeout < 0) break;
+
+	I2C1->CTLR2 |= I2C_IT_ALL;
+	xfer_phase(XFER_START);
+	I2C1->CTLR1 |= I2C_CTLR1_START;
+}
+
+/// @brief Ends the running transfer, reports it and starts the next one
+/// @param status, result of the transfer
+/// @return None
+static void xfer_end(const i2c_err_t status)
+{
+	i2c_callback_t callback = xfer_queue[queue_head].callback;
+
+	DMA1_Channel6->CFGR &= ~DMA_CFGR1_EN;
+	DMA1_Channel7->CFGR &= ~DMA_CFGR1_EN;
+	I2C1->CTLR2 &= ~(I2C_IT_ALL | I2C_CTLR2_DMAEN | I2C_CTLR2_LAST);
+	if(status != I2C_OK) I2C1->CTLR1 |= I2C_CTLR1_STOP;
+
+	last_status = status;
+	queue_head = (queue_head + 1) & (I2C_QUEUE_LEN - 1);
+	if(callback != NULL) callback(status);
+
+	xfer_begin();
+}
+
 
 
 /*** API Functions ***********************************************************/
@@ -106,6 +330,7 @@ i2c_err_t i2c_init(uint32_t clk_rate)
 	uint16_t i2c_conf = I2C1->CTLR2 & ~I2C_CTLR2_FREQ;
 	i2c_conf |= (FUNCONF_SYSTEM_CORE_CLOCK / I2C_PRERATE) & I2C_CTLR2_FREQ;
 	I2C1->CTLR2 = i2c_conf;
+	saved_ctlr2 = i2c_conf;
 
 	// Set I2C Clock
 	if(clk_rate <= 100000)
@@ -117,10 +342,26 @@ i2c_err_t i2c_init(uint32_t clk_rate)
 		i2c_conf |= I2C_CKCFGR_FS;
 	}
 	I2C1->CKCFGR = i2c_conf;
+	saved_ckcfgr = i2c_conf;
 
 	// Enable the I2C Peripheral
 	I2C1->CTLR1 |= I2C_CTLR1_PE;
 
+	// DMA1 Channel 6 is I2C1 TX, used for the data phase of queued writes
+	RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+	DMA1_Channel6->CFGR = 0;
+	DMA1_Channel6->PADDR = (uint32_t)&I2C1->DATAR;
+
+	// DMA1 Channel 7 is I2C1 RX, used for long sync reads and queued reads
+	DMA1_Channel7->CFGR = 0;
+	DMA1_Channel7->PADDR = (uint32_t)&I2C1->DATAR;
+	NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+	// Event and error interrupts drive the queue, they stay masked in
+	// CTLR2 while the sync functions are using the bus
+	NVIC_EnableIRQ(I2C1_EV_IRQn);
+	NVIC_EnableIRQ(I2C1_ER_IRQn);
+
 	//TODO:
 	// Check error states
 	if(I2C1->STAR1 & I2C_STAR1_BERR) 
@@ -133,30 +374,57 @@ i2c_err_t i2c_init(uint32_t clk_rate)
 }
 
 
-i2c_err_t i2c_ping(const uint8_t addr)
+void i2c_bus_recover(void)
 {
-	i2c_err_t i2c_ret = I2C_OK;
-
-	// Wait for the bus to become not busy - return I2C_ERR_TIMEOUT on failure
-	int32_t timeout = I2C_TIMEOUT;
-	while(I2C1->STAR2 & I2C_STAR2_BUSY) 
-		if(--timeout < 0) i2c_ret = I2C_ERR_BUSY;
+	// Take the pins away from the peripheral, as open drain outputs
+	I2C1->CTLR1 &= ~I2C_CTLR1_PE;
+	I2C_PORT->BSHR = (1 << I2C_PIN_SCL) | (1 << I2C_PIN_SDA);
+	I2C_PORT->CFGLR &= ~(0x0F << (4 * I2C_PIN_SDA));
+	I2C_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_OD) << (4 * I2C_PIN_SDA);
+	I2C_PORT->CFGLR &= ~(0x0F << (4 * I2C_PIN_SCL));
+	I2C_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_OD) << (4 * I2C_PIN_SCL);
 
-	if(i2c_ret == I2C_OK)
+	// A slave stopped mid byte holds SDA low, clock it out. 9 clocks covers
+	// 8 data bits and the ACK
+	for(uint8_t clk = 0; clk < 9 && !(I2C_PORT->INDR & (1 << I2C_PIN_SDA)); clk++)
 	{
-		// Send a START Signal and wait for it to assert
-		I2C1->CTLR1 |= I2C_CTLR1_START;
-		while(!i2c_status(I2C_EVENT_MASTER_MODE_SELECT));
-
-		// Send the Address and wait for it to finish transmitting
-		timeout = I2C_TIMEOUT;
-		I2C1->DATAR = (addr << 1) & 0xFE;
-		// If the device times out, get the error status - if status is okay,
-		// return generic I2C_ERR_BUSY Flag
-		while(!i2c_status(I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED))
-			if(--timeout < 0) {i2c_ret = i2c_get_busy_error(); break;}
+		I2C_PORT->BCR = 1 << I2C_PIN_SCL;
+		Delay_Us(5);
+		I2C_PORT->BSHR = 1 << I2C_PIN_SCL;
+		Delay_Us(5);
 	}
 
+	// STOP: SDA rises while SCL is high
+	I2C_PORT->BCR = 1 << I2C_PIN_SCL;
+	Delay_Us(5);
+	I2C_PORT->BCR = 1 << I2C_PIN_SDA;
+	Delay_Us(5);
+	I2C_PORT->BSHR = 1 << I2C_PIN_SCL;
+	Delay_Us(5);
+	I2C_PORT->BSHR = 1 << I2C_PIN_SDA;
+	Delay_Us(5);
+
+	// Give the pins back, reset the peripheral as it may still think the
+	// bus is busy, and restore its clock setup
+	I2C_PORT->CFGLR &= ~(0x0F << (4 * I2C_PIN_SDA));
+	I2C_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_OD_AF) << (4 * I2C_PIN_SDA);
+	I2C_PORT->CFGLR &= ~(0x0F << (4 * I2C_PIN_SCL));
+	I2C_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_OD_AF) << (4 * I2C_PIN_SCL);
+
+	I2C1->CTLR1 |= I2C_CTLR1_SWRST;
+	I2C1->CTLR1 &= ~I2C_CTLR1_SWRST;
+	I2C1->CTLR2 = saved_ctlr2;
+	I2C1->CKCFGR = saved_ckcfgr;
+	I2C1->CTLR1 |= I2C_CTLR1_PE;
+}
+
+
+i2c_err_t i2c_ping(const uint8_t addr)
+{
+	i2c_async_wait();
+
+	i2c_err_t i2c_ret = i2c_start(addr, 0);
+
 	// Send the STOP Signal, return i2c status
 	I2C1->CTLR1 |= I2C_CTLR1_STOP;
 	return i2c_ret;
@@ -181,69 +449,41 @@ i2c_err_t i2c_read(const uint8_t addr,		const uint8_t reg,
 											uint8_t *buf,
 											const uint8_t len)
 {
-	i2c_err_t i2c_ret = I2C_OK;
+	i2c_async_wait();
 
-	// Wait for the bus to become not busy - set state to I2C_ERR_TIMEOUT on failure
-	int32_t timeout = I2C_TIMEOUT;
-	while(I2C1->STAR2 & I2C_STAR2_BUSY) 
-		if(--timeout < 0) {i2c_ret = i2c_get_busy_error(); break;}
-	
-	if(i2c_ret == I2C_OK)
-	{
-		// Send a START Signal and wait for it to assert
-		I2C1->CTLR1 |= I2C_CTLR1_START;
-		while(!i2c_status(I2C_EVENT_MASTER_MODE_SELECT));
-
-		// Send the Address and wait for it to finish transmitting
-		timeout = I2C_TIMEOUT;
-		I2C1->DATAR = (addr << 1) & 0xFE;
-		while(!i2c_status(I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED))
-			if(--timeout < 0) {i2c_ret = i2c_get_busy_error(); break;}
-	}
+	// Nothing to read, this is only a register write
+	if(len == 0) return i2c_write(addr, reg, NULL, 0);
+
+	i2c_err_t i2c_ret = i2c_start(addr, 0);
 
 	if(i2c_ret == I2C_OK)
 	{
 		// Send the Register Byte
 		I2C1->DATAR = reg;
-		while(!(I2C1->STAR1 & I2C_STAR1_TXE));
-
-		// If the message is long enough, enable ACK messages
-		if(len > 1) I2C1->CTLR1 |= I2C_CTLR1_ACK;
-
-		// Send a Repeated START Signal and wait for it to assert
-		I2C1->CTLR1 |= I2C_CTLR1_START;
-		while(!i2c_status(I2C_EVENT_MASTER_MODE_SELECT));
-
-		// Send Read Address
-		timeout = I2C_TIMEOUT;
-		I2C1->DATAR = (addr << 1) | 0x01;
-		while(!i2c_status(I2C_EVENT_MASTER_RECEIVER_MODE_SELECTED))
-			if(--timeout < 0) {i2c_ret = i2c_get_busy_error(); break;}
+		i2c_ret = i2c_wait(I2C_STAR1_TXE);
 	}
 
 	if(i2c_ret == I2C_OK)
 	{
-		// Read bytes
-		uint8_t cbyte = 0;
-		while(cbyte < len)
-		{
-			// If this is the last byte, send the NACK Bit
-			if(cbyte == len) I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
+		// ACK and POS have to be set up before ADDR is cleared
+		if(len == 2) I2C1->CTLR1 |= I2C_CTLR1_POS | I2C_CTLR1_ACK;
+		else if(len > 2) I2C1->CTLR1 |= I2C_CTLR1_ACK;
+		else I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
 
-			// Wait until the Read Register isn't empty
-			while(!(I2C1->STAR1 & I2C_STAR1_RXNE));
-			buf[cbyte] = I2C1->DATAR;
-
-			// Make sure no errors occured
-			if((i2c_ret = i2c_error()) != I2C_OK) break;
+		// Send a Repeated START and the Read Address
+		i2c_ret = i2c_start(addr, 1);
+	}
 
-			++cbyte;
-		}
+	if(i2c_ret == I2C_OK)
+	{
+		if(len >= I2C_READ_DMA_MIN) i2c_ret = i2c_read_dma(buf, len);
+		else i2c_ret = i2c_read_burst(buf, len);
 	}
 
-	// Send the STOP Condition to auto-reset for the next operation
-	I2C1->CTLR1 |= I2C_CTLR1_STOP;
+	// Send the STOP Condition if the read did not get that far
+	if(i2c_ret != I2C_OK) I2C1->CTLR1 |= I2C_CTLR1_STOP;
 
+	I2C1->CTLR1 &= ~(I2C_CTLR1_POS | I2C_CTLR1_ACK);
 	return i2c_ret;
 }
 
@@ -252,39 +492,25 @@ i2c_err_t i2c_write(const uint8_t addr,		const uint8_t reg,
 											const uint8_t *buf,
 											const uint8_t len)
 {
-	i2c_err_t i2c_ret = I2C_OK;
+	i2c_async_wait();
 
-	// Wait for the bus to become not busy - set state to I2C_ERR_TIMEOUT on failure
-	int32_t timeout = I2C_TIMEOUT;
-	while(I2C1->STAR2 & I2C_STAR2_BUSY) 
-		if(--timeout < 0) {i2c_ret = i2c_get_busy_error(); break;}
+	i2c_err_t i2c_ret = i2c_start(addr, 0);
 
 	if(i2c_ret == I2C_OK)
 	{
-		// Send a START Signal and wait for it to assert
-		I2C1->CTLR1 |= I2C_CTLR1_START;
-		while(!i2c_status(I2C_EVENT_MASTER_MODE_SELECT));
-
-		// Send the Address and wait for it to finish transmitting
-		timeout = I2C_TIMEOUT;
-		I2C1->DATAR = (addr << 1) & 0xFE;
-		while(!i2c_status(I2C_EVENT_MASTER_TRANSMITTER_MODE_SELECTED))
-			if(--timeout < 0) {i2c_ret = i2c_get_busy_error(); break;}
+		// Send the Register Byte
+		I2C1->DATAR = reg;
+		i2c_ret = i2c_wait(I2C_STAR1_TXE);
 	}
 
-
 	if(i2c_ret == I2C_OK)
 	{
-		// Send the Register Byte
-		I2C1->DATAR = reg;
-		while(!(I2C1->STAR1 & I2C_STAR1_TXE));
-
 		// Write bytes
 		uint8_t cbyte = 0;
 		while(cbyte < len)
 		{
 			// Write the byte and wait for it to finish transmitting
-			while(!(I2C1->STAR1 & I2C_STAR1_TXE));
+			if((i2c_ret = i2c_wait(I2C_STAR1_TXE)) != I2C_OK) break;
 			I2C1->DATAR = buf[cbyte];
 
 			// Make sure no errors occured
@@ -294,11 +520,203 @@ i2c_err_t i2c_write(const uint8_t addr,		const uint8_t reg,
 		}
 
 		// Wait for the bus to finish transmitting
-		while(!i2c_status(I2C_EVENT_MASTER_BYTE_TRANSMITTED));
+		if(i2c_ret == I2C_OK) i2c_ret = i2c_wait(I2C_EVENT_MASTER_BYTE_TRANSMITTED);
 	}
 
 	// Send a STOP Condition, to aut-reset for the next operation
 	I2C1->CTLR1 |= I2C_CTLR1_STOP;
 
 	return i2c_ret;
-}
\ No newline at end of file
+}
+
+
+i2c_err_t i2c_submit(const i2c_xfer_t *xfer)
+{
+	uint8_t next = (queue_tail + 1) & (I2C_QUEUE_LEN - 1);
+	if(next == queue_head) return I2C_ERR_BUSY;
+
+	xfer_queue[queue_tail] = *xfer;
+	// A read with nothing to read is just the register write
+	if(xfer->len == 0) xfer_queue[queue_tail].read = 0;
+
+	// The ISR may be finishing the last transfer right now
+	__disable_irq();
+	queue_tail = next;
+	if(xfer_state == XFER_IDLE) xfer_begin();
+	__enable_irq();
+
+	return I2C_OK;
+}
+
+
+i2c_err_t i2c_write_async(const uint8_t addr,	const uint8_t reg,
+												const uint8_t *buf,
+												const uint8_t len,
+												i2c_callback_t callback)
+{
+	i2c_xfer_t xfer = {addr, reg, (uint8_t *)buf, len, 0, callback};
+	return i2c_submit(&xfer);
+}
+
+
+i2c_err_t i2c_read_async(const uint8_t addr,	const uint8_t reg,
+												uint8_t *buf,
+												const uint8_t len,
+												i2c_callback_t callback)
+{
+	i2c_xfer_t xfer = {addr, reg, buf, len, 1, callback};
+	return i2c_submit(&xfer);
+}
+
+
+void i2c_poll(void)
+{
+	if(xfer_state == XFER_IDLE) return;
+	if(SysTick->CNT - phase_start <= I2C_PHASE_TICKS) return;
+
+	__disable_irq();
+	// Check again, the phase may have moved on since
+	if(xfer_state != XFER_IDLE && SysTick->CNT - phase_start > I2C_PHASE_TICKS)
+	{
+		I2C1->CTLR2 &= ~(I2C_IT_ALL | I2C_CTLR2_DMAEN | I2C_CTLR2_LAST);
+		DMA1_Channel6->CFGR &= ~DMA_CFGR1_EN;
+		DMA1_Channel7->CFGR &= ~DMA_CFGR1_EN;
+		i2c_bus_recover();
+		xfer_end(I2C_ERR_BUSY);
+	}
+	__enable_irq();
+}
+
+
+i2c_err_t i2c_async_status(void)
+{
+	i2c_poll();
+	if(xfer_state != XFER_IDLE) return I2C_PENDING;
+	return last_status;
+}
+
+
+i2c_err_t i2c_async_wait(void)
+{
+	i2c_err_t i2c_ret;
+	while((i2c_ret = i2c_async_status()) == I2C_PENDING);
+	return i2c_ret;
+}
+
+
+
+/*** Interrupt Handlers ******************************************************/
+void I2C1_EV_IRQHandler(void) __attribute__((interrupt));
+void I2C1_EV_IRQHandler(void)
+{
+	uint16_t star1 = I2C1->STAR1;
+	i2c_xfer_t *xfer = &xfer_queue[queue_head];
+
+	switch(xfer_state)
+	{
+		case XFER_START:
+			if(!(star1 & I2C_STAR1_SB)) break;
+			I2C1->DATAR = (xfer->addr << 1) & 0xFE;
+			xfer_phase(XFER_ADDR);
+			break;
+
+		case XFER_ADDR:
+			if(!(star1 & I2C_STAR1_ADDR)) break;
+			(void)I2C1->STAR2;	// Reading STAR2 clears ADDR
+			I2C1->DATAR = xfer->reg;
+			xfer_phase(XFER_REG);
+			break;
+
+		case XFER_REG:
+			if(!(star1 & I2C_STAR1_TXE)) break;
+			// TXE stays set from here on, the buffer interrupt would refire
+			I2C1->CTLR2 &= ~I2C_CTLR2_ITBUFEN;
+			if(xfer->read)
+			{
+				I2C1->CTLR1 |= I2C_CTLR1_START;
+				xfer_phase(XFER_RESTART);
+			} else {
+				// The DMA keeps DATAR full, so BTF only sets after the last byte
+				DMA1_Channel6->MADDR = (uint32_t)xfer->buf;
+				DMA1_Channel6->CNTR = xfer->len;
+				if(xfer->len)
+				{
+					DMA1_Channel6->CFGR = DMA_CFGR1_MINC | DMA_CFGR1_DIR | DMA_CFGR1_EN;
+					I2C1->CTLR2 |= I2C_CTLR2_DMAEN;
+				}
+				xfer_phase(XFER_WRITE);
+			}
+			break;
+
+		case XFER_WRITE:
+			if(!(star1 & I2C_STAR1_BTF) || DMA1_Channel6->CNTR != 0) break;
+			I2C1->CTLR1 |= I2C_CTLR1_STOP;
+			xfer_end(I2C_OK);
+			break;
+
+		case XFER_RESTART:
+			if(!(star1 & I2C_STAR1_SB)) break;
+			I2C1->DATAR = (xfer->addr << 1) | 0x01;
+			xfer_phase(XFER_READ_ADDR);
+			break;
+
+		case XFER_READ_ADDR:
+			if(!(star1 & I2C_STAR1_ADDR)) break;
+			if(xfer->len == 1)
+			{
+				// Single byte: NACK it, ACK has to be off before ADDR clears
+				I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
+				(void)I2C1->STAR2;
+				I2C1->CTLR1 |= I2C_CTLR1_STOP;
+				I2C1->CTLR2 |= I2C_CTLR2_ITBUFEN;
+				xfer_phase(XFER_READ);
+			} else {
+				// Let the DMA take the bytes, LAST NACKs the final one. Doing
+				// this per byte from RXNE can miss the NACK point under load
+				DMA1_Channel7->MADDR = (uint32_t)xfer->buf;
+				DMA1_Channel7->CNTR = xfer->len;
+				DMA1_Channel7->CFGR = DMA_CFGR1_MINC | DMA_CFGR1_TCIE | DMA_CFGR1_EN;
+				I2C1->CTLR2 |= I2C_CTLR2_DMAEN | I2C_CTLR2_LAST;
+				I2C1->CTLR1 |= I2C_CTLR1_ACK;
+				(void)I2C1->STAR2;
+				xfer_phase(XFER_READ_DMA);
+			}
+			break;
+
+		case XFER_READ:
+			if(!(star1 & I2C_STAR1_RXNE)) break;
+			xfer->buf[0] = I2C1->DATAR;
+			xfer_end(I2C_OK);
+			break;
+
+		default:
+			I2C1->CTLR2 &= ~I2C_IT_ALL;
+			break;
+	}
+}
+
+
+void DMA1_Channel7_IRQHandler(void) __attribute__((interrupt));
+void DMA1_Channel7_IRQHandler(void)
+{
+	DMA1->INTFCR = DMA1_IT_GL7;
+	if(xfer_state != XFER_READ_DMA) return;
+
+	// The last byte is in and was NACKed
+	I2C1->CTLR1 |= I2C_CTLR1_STOP;
+	I2C1->CTLR1 &= ~I2C_CTLR1_ACK;
+	xfer_end(I2C_OK);
+}
+
+
+void I2C1_ER_IRQHandler(void) __attribute__((interrupt));
+void I2C1_ER_IRQHandler(void)
+{
+	i2c_err_t i2c_err = i2c_error();
+
+	// Clear anything i2c_error() does not know about
+	I2C1->STAR1 &= ~(I2C_STAR1_BERR | I2C_STAR1_AF | I2C_STAR1_ARLO | I2C_STAR1_OVR |
+					 I2C_STAR1_PECERR | I2C_STAR1_TIMEOUT);
+
+	if(xfer_state != XFER_IDLE) xfer_end(i2c_err == I2C_OK ? I2C_ERR_BERR : i2c_err);
+}
@@ -57,6 +57,14 @@
 #define I2C_PRERATE 1000000
 #define I2C_TIMEOUT 2000
 
+// Queued transfers: queue depth (power of 2), and how long any one phase of
+// a transfer may take before i2c_poll() recovers the bus
+#define I2C_QUEUE_LEN 4
+#define I2C_PHASE_TIMEOUT_US 2000
+
+// Sync reads of this many bytes or more use DMA1 Channel 7
+#define I2C_READ_DMA_MIN 8
+
 // Default Pinout
 #ifdef I2C_PINOUT_DEFAULT
 	#define I2C_AFIO_REG	((uint32_t)0x00000000)
@@ -92,8 +100,23 @@ typedef enum {
 	I2C_ERR_ARLO,	 // Arbitration Lost
 	I2C_ERR_OVR,	  // Overun/underrun condition
 	I2C_ERR_BUSY,	 // Bus was busy and timed out
+	I2C_PENDING,	 // Async transfer still running
 } i2c_err_t;
 
+/// @brief Called when an async transfer finishes, from interrupt context
+typedef void (*i2c_callback_t)(const i2c_err_t);
+
+/// @brief Transfer descriptor for the queue. [reg] is always written first,
+/// then [len] bytes of [buf] are written, or read after a repeated START
+typedef struct {
+	uint8_t addr;				// 7 Bit device address
+	uint8_t reg;				// register / first byte
+	uint8_t *buf;				// MUST stay valid until the transfer ends
+	uint8_t len;				// data bytes, may be 0
+	uint8_t read;				// 1 to read into buf, 0 to write from it
+	i2c_callback_t callback;	// called when the transfer ends, may be NULL
+} i2c_xfer_t;
+
 
 /*** Functions ***************************************************************/
 /// @brief Initialise the I2C Peripheral on the default pins, in Master Mode
@@ -111,7 +134,9 @@ i2c_err_t i2c_ping(const uint8_t addr);
 /// @return None
 void i2c_scan(void (*callback)(const uint8_t));
 
-/// @brief reads [len] bytes from [addr]s [reg] register into [buf]
+/// @brief reads [len] bytes from [addr]s [reg] register into [buf]. 1, 2 and
+/// N byte reads each use their own ACK/NACK/STOP sequence, so the last byte
+/// is always NACKed. Reads of I2C_READ_DMA_MIN bytes or more go over DMA
 /// @param addr, address of I2C Device to Read from, MUST BE 7 Bit
 /// @param buf, buffer to read to
 /// @param len, number of bytes to read
@@ -129,4 +154,57 @@ i2c_err_t i2c_write(const uint8_t addr,	const uint8_t reg,
 										const uint8_t *buf,
 										const uint8_t len);
 
+/// @brief Sends 9 clocks and a STOP by hand to free a slave holding SDA
+/// low, then resets and re-enables the I2C Peripheral
+/// @param None
+/// @return None
+void i2c_bus_recover(void);
+
+/// @brief Queues a transfer. The I2C event and error interrupts run it
+/// without the CPU waiting, write data goes out over DMA1 Channel 6.
+/// Any sync call waits for the queue to empty first.
+/// @param xfer, descriptor, copied into the queue
+/// @return i2c_err_t. I2C_OK if queued, I2C_ERR_BUSY if the queue is full
+i2c_err_t i2c_submit(const i2c_xfer_t *xfer);
+
+/// @brief Queues a write of [len] bytes from [buf] to the [reg] of [addr]
+/// @param addr, Address of the I2C Device to Write to, MUST BE 7 Bit
+/// @param buf, Buffer to write from, MUST stay valid until the transfer ends
+/// @param len, number of bytes to write
+/// @param callback, called when the transfer ends, may be NULL
+/// @return i2c_err_t. I2C_OK if queued
+i2c_err_t i2c_write_async(const uint8_t addr,	const uint8_t reg,
+												const uint8_t *buf,
+												const uint8_t len,
+												i2c_callback_t callback);
+
+/// @brief Queues a read of [len] bytes from [addr]s [reg] register to [buf]
+/// @param addr, Address of the I2C Device to Read from, MUST BE 7 Bit
+/// @param buf, Buffer to read to, MUST stay valid until the transfer ends
+/// @param len, number of bytes to read
+/// @param callback, called when the transfer ends, may be NULL
+/// @return i2c_err_t. I2C_OK if queued
+i2c_err_t i2c_read_async(const uint8_t addr,	const uint8_t reg,
+												uint8_t *buf,
+												const uint8_t len,
+												i2c_callback_t callback);
+
+/// @brief Watchdog for the queue. If a transfer is stuck in one phase for
+/// longer than I2C_PHASE_TIMEOUT_US, recovers the bus and ends it with
+/// I2C_ERR_BUSY. Call regularly from the main loop
+/// @param None
+/// @return None
+void i2c_poll(void);
+
+/// @brief Gets the state of the queue, runs i2c_poll()
+/// @param None
+/// @return i2c_err_t. I2C_PENDING while transfers remain, else the result
+/// of the last one
+i2c_err_t i2c_async_status(void);
+
+/// @brief Blocks until every queued transfer has finished
+/// @param None
+/// @return i2c_err_t. Result of the last transfer
+i2c_err_t i2c_async_wait(void);
+
 #endif
\ No newline at end of file
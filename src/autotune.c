@@ -0,0 +1,124 @@
+#include "autotune.h"
+
+void autotune_start(AutoTune *tune, temp_q2_t setpoint, uint16_t out_max, uint32_t now)
+{
+	tune->state = AUTOTUNE_RUNNING;
+	tune->output_high = false;
+	tune->cycles = 0;
+	tune->setpoint = setpoint;
+	tune->peak_high = INT16_MIN;
+	tune->peak_low = INT16_MAX;
+	tune->out_max = out_max;
+	tune->start_ms = now;
+	tune->rise_ms = now;
+	tune->period_sum = 0;
+	tune->swing_sum = 0;
+}
+
+void autotune_abort(AutoTune *tune)
+{
+	if (tune->state == AUTOTUNE_RUNNING)
+	{
+		tune->state = AUTOTUNE_FAILED;
+	}
+}
+
+uint16_t autotune_update(AutoTune *tune, temp_q2_t measured, uint32_t now)
+{
+	if (tune->state != AUTOTUNE_RUNNING)
+	{
+		return 0;
+	}
+	if (now - tune->start_ms > AUTOTUNE_TIMEOUT_MS)
+	{
+		tune->state = AUTOTUNE_FAILED;
+		return 0;
+	}
+
+	if (measured > tune->peak_high)
+	{
+		tune->peak_high = measured;
+	}
+	if (measured < tune->peak_low)
+	{
+		tune->peak_low = measured;
+	}
+
+	if (!tune->output_high && measured > tune->setpoint + AUTOTUNE_HYSTERESIS)
+	{
+		// A cycle runs from one switch on to the next. The first only
+		// settles the oscillation and is not averaged
+		if (tune->cycles > 1)
+		{
+			tune->period_sum += now - tune->rise_ms;
+			tune->swing_sum += tune->peak_high - tune->peak_low;
+		}
+		tune->peak_high = measured;
+		tune->peak_low = measured;
+		tune->rise_ms = now;
+		tune->output_high = true;
+
+		if (tune->cycles++ == AUTOTUNE_CYCLES + 1)
+		{
+			tune->state = AUTOTUNE_DONE;
+			return 0;
+		}
+	}
+	else if (tune->output_high && measured < tune->setpoint - AUTOTUNE_HYSTERESIS)
+	{
+		tune->output_high = false;
+	}
+
+	return tune->output_high ? tune->out_max : 0;
+}
+
+// Scales a gain down into the byte the settings hold, rounded. false if it
+// does not fit, a clamped gain is not the controller the tune worked out
+static bool gain(uint32_t value, uint8_t shift, uint8_t *out)
+{
+	value = (value + ((1UL << shift) >> 1)) >> shift;
+	if (value > UINT8_MAX)
+	{
+		return false;
+	}
+	*out = value;
+	return true;
+}
+
+bool autotune_gains(AutoTune *tune, PidConfig *config)
+{
+	if (tune->state != AUTOTUNE_DONE)
+	{
+		return false;
+	}
+
+	// Relay amplitude h is half the output swing, a is half the temperature
+	// swing. The sums hold AUTOTUNE_CYCLES cycles, so the cycle count
+	// cancels out of the amplitude ratios. Tu is rounded to whole updates.
+	uint32_t h = tune->out_max >> 1;
+	uint32_t swing = tune->swing_sum ? tune->swing_sum : 1; // 2a * cycles
+	uint32_t tu = (tune->period_sum / AUTOTUNE_CYCLES + AUTOTUNE_UPDATE_MS / 2) / AUTOTUNE_UPDATE_MS;
+	if (tu == 0)
+	{
+		tu = 1;
+	}
+
+	// Ku = 4h / (pi a), in output per 0.25C. With PID_SHIFT = 2 the integer
+	// gains are 4x the real ones, before each is scaled into its byte:
+	//   kp = 4 * 0.6 Ku        = 6.112 h / 2a
+	//   ki = 4 * 1.2 Ku / Tu   = 12.22 h / (2a Tu)
+	//   kd = 4 * 0.075 Ku Tu   = 0.764 h Tu / 2a
+	uint32_t hc = h * AUTOTUNE_CYCLES;
+	uint8_t kp, ki, kd;
+	if (!gain((hc * 6112 + swing * 500) / (swing * 1000), PID_KP_SHIFT, &kp) ||
+		!gain((hc * 12223 + swing * tu * 500) / (swing * tu * 1000), 0, &ki) ||
+		!gain((hc * tu * 764 + swing * 500) / (swing * 1000), PID_KD_SHIFT, &kd))
+	{
+		tune->state = AUTOTUNE_FAILED;
+		return false;
+	}
+	config->kp = kp;
+	config->ki = ki;
+	config->kd = kd;
+	return true;
+}
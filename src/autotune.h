@@ -0,0 +1,75 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "pid.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Relay auto-tuner (Astrom-Hagglund). The fans are switched fully on above
+ * the setpoint and off below it, which makes the temperature oscillate.
+ * Averaging the period Tu and the peak to peak swing over a few cycles
+ * gives the ultimate gain Ku = 4h / (pi * a), and Ziegler-Nichols turns Ku
+ * and Tu into PID gains in the units of pid.c. Hardware free, time comes in
+ * from the caller.
+ */
+#define AUTOTUNE_HYSTERESIS 2		   // 0.25C units either side of the setpoint
+#define AUTOTUNE_CYCLES 4			   // cycles averaged, after one settling cycle
+#define AUTOTUNE_TIMEOUT_MS 5400000UL // give up after 90 minutes
+#define AUTOTUNE_UPDATE_MS 1000	   // rate the PID runs at, the gains assume it
+
+typedef enum
+{
+	AUTOTUNE_IDLE,
+	AUTOTUNE_RUNNING,
+	AUTOTUNE_DONE,
+	AUTOTUNE_FAILED
+} AutoTuneState;
+
+typedef struct
+{
+	AutoTuneState state;
+	bool output_high;
+	uint8_t cycles;		   // switches to high so far, cycle n ends at switch n + 1
+	temp_q2_t setpoint;
+	temp_q2_t peak_high;   // extremes of the cycle in progress
+	temp_q2_t peak_low;
+	uint16_t out_max;	   // relay high output
+	uint32_t start_ms;
+	uint32_t rise_ms;	   // time of the last switch to high
+	uint32_t period_sum;   // ms, over the counted cycles
+	uint32_t swing_sum;	   // peak to peak 0.25C, over the counted cycles
+} AutoTune;
+
+/**
+ * @brief Starts a tune around setpoint, relay output 0 / out_max.
+ */
+void autotune_start(AutoTune *tune, temp_q2_t setpoint, uint16_t out_max, uint32_t now);
+
+/**
+ * @brief Stops a running tune, the state becomes AUTOTUNE_FAILED.
+ */
+void autotune_abort(AutoTune *tune);
+
+/**
+ * @brief Feeds one measurement, call at least every few seconds.
+ * @return Output to apply, 0 once the tune has ended.
+ */
+uint16_t autotune_update(AutoTune *tune, temp_q2_t measured, uint32_t now);
+
+/**
+ * @brief Averaged cycle in progress, 1..AUTOTUNE_CYCLES, 0 while settling.
+ */
+static inline uint8_t autotune_cycle(const AutoTune *tune)
+{
+	return tune->cycles > 1 ? tune->cycles - 1 : 0;
+}
+
+/**
+ * @brief Writes the tuned gains into config, only once AUTOTUNE_DONE. A
+ * gain too large for its PidConfig byte fails the tune instead.
+ * @return true if the gains were written.
+ */
+bool autotune_gains(AutoTune *tune, PidConfig *config);
+
+#endif
@@ -0,0 +1,131 @@
+#include "button.h"
+#include "systime.h"
+
+// Debounced edges, the interrupt is the only producer and
+// button_update() the only consumer
+static InputQueue edges;
+
+// Debounced state, owned by the interrupt
+static volatile bool stable_pressed;
+static volatile uint32_t stable_time;
+
+// Gesture decoder
+static uint32_t press_time;
+static uint32_t click_time;
+static bool held;
+static bool long_sent;
+static bool click_open; // a click that a second one could make double
+
+static bool button_down(void)
+{
+	return !(BUTTON_PORT->INDR & (1 << BUTTON_PIN));
+}
+
+static void button_push(InputQueue *queue, button_event_t event, uint32_t time)
+{
+	input_put(queue, INPUT_BUTTON, event, 0, time);
+}
+
+void button_init(void)
+{
+	RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_AFIO;
+
+	// Input with pull-up
+	BUTTON_PORT->CFGLR &= ~(0xF << (4 * BUTTON_PIN));
+	BUTTON_PORT->CFGLR |= GPIO_CNF_IN_PUPD << (4 * BUTTON_PIN);
+	BUTTON_PORT->BSHR = 1 << BUTTON_PIN;
+
+	stable_pressed = button_down();
+	stable_time = millis();
+
+	// EXTI line from port C, both edges
+	AFIO->EXTICR = (AFIO->EXTICR & ~(0x3 << (2 * BUTTON_PIN))) | (BUTTON_PORT_SOURCE << (2 * BUTTON_PIN));
+	EXTI->FTENR |= 1 << BUTTON_PIN;
+	EXTI->RTENR |= 1 << BUTTON_PIN;
+	EXTI->INTENR |= 1 << BUTTON_PIN;
+
+	NVIC_EnableIRQ(EXTI7_0_IRQn);
+}
+
+void button_edge(void)
+{
+	uint32_t now = millis();
+	bool pressed = button_down();
+
+	// Bounces back to the settled state, or too soon after the last change
+	if (pressed == stable_pressed || now - stable_time < BUTTON_DEBOUNCE_MS)
+	{
+		return;
+	}
+	stable_pressed = pressed;
+	stable_time = now;
+
+	// On a full queue the decoder sees two edges in a row the same way
+	// and resyncs on the next one
+	input_put(&edges, INPUT_EDGE, pressed, 0, now);
+}
+
+void button_update(InputQueue *queue)
+{
+	InputEvent edge;
+
+	// The edge that ended the bounce may have come inside the window and
+	// been dropped. Once the window is over, raise the interrupt by
+	// software so it picks the level up and stays the only producer
+	if (button_down() != stable_pressed && elapsed_ms(stable_time) >= BUTTON_DEBOUNCE_MS)
+	{
+		EXTI->SWIEVR = 1 << BUTTON_PIN;
+	}
+
+	while (input_get(&edges, &edge))
+	{
+		uint32_t time = edge.time;
+		bool pressed = edge.code;
+
+		if (pressed && !held)
+		{
+			held = true;
+			long_sent = false;
+			press_time = time;
+			button_push(queue, BUTTON_PRESS, time);
+		}
+		else if (!pressed && held)
+		{
+			held = false;
+
+			// Released before the long press was seen, from the stamps
+			if (!long_sent && time - press_time >= BUTTON_LONG_MS)
+			{
+				long_sent = true;
+				button_push(queue, BUTTON_LONG_PRESS, press_time + BUTTON_LONG_MS);
+			}
+			if (long_sent)
+			{
+				click_open = false;
+			}
+			else if (click_open && press_time - click_time <= BUTTON_DOUBLE_MS)
+			{
+				click_open = false;
+				button_push(queue, BUTTON_DOUBLE_CLICK, time);
+			}
+			else
+			{
+				click_open = true;
+				click_time = time;
+				button_push(queue, BUTTON_CLICK, time);
+			}
+			button_push(queue, BUTTON_RELEASE, time);
+		}
+	}
+
+	if (held && !long_sent && elapsed_ms(press_time) >= BUTTON_LONG_MS)
+	{
+		long_sent = true;
+		button_push(queue, BUTTON_LONG_PRESS, press_time + BUTTON_LONG_MS);
+	}
+}
+
+uint16_t button_overflows(void)
+{
+	return edges.overflows;
+}
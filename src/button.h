@@ -0,0 +1,57 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include "ch32v003fun.h"
+#include "input.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Encoder push button on PC3 (EXTI line 3, pulled up, low when pressed).
+ * The interrupt stamps each edge with millis() and debounces it by time:
+ * a change of state is only taken BUTTON_DEBOUNCE_MS after the last one.
+ * Accepted edges are queued, button_update() turns them into gestures
+ * from their stamps, so how late the foreground gets to them does not
+ * change what was pressed. Gestures go out as INPUT_BUTTON events.
+ */
+#define BUTTON_PORT GPIOC
+#define BUTTON_PIN 3	   // also the EXTI line
+#define BUTTON_PORT_SOURCE 0x2 // AFIO EXTICR value of port C
+
+#define BUTTON_DEBOUNCE_MS 20
+#define BUTTON_LONG_MS 800	 // held this long is a long press
+#define BUTTON_DOUBLE_MS 300 // click pressed again within this is a double click
+
+typedef enum
+{
+	BUTTON_NONE,
+	BUTTON_PRESS,		 // went down
+	BUTTON_RELEASE,		 // came up, always the last event of a press
+	BUTTON_CLICK,		 // came up before BUTTON_LONG_MS
+	BUTTON_DOUBLE_CLICK, // second click soon after a click, instead of BUTTON_CLICK
+	BUTTON_LONG_PRESS,	 // held BUTTON_LONG_MS, no click follows
+} button_event_t;
+
+/**
+ * @brief Sets up the pin and its EXTI line, both edges.
+ */
+void button_init(void);
+
+/**
+ * @brief Edge interrupt body, called from the EXTI handler.
+ */
+void button_edge(void);
+
+/**
+ * @brief Decodes queued edges into events. Call regularly, the long press
+ * is found here while the button is held.
+ * @param queue Gets the events, this must be its only producer.
+ */
+void button_update(InputQueue *queue);
+
+/**
+ * @brief Edges dropped because the decoder fell a whole queue behind.
+ */
+uint16_t button_overflows(void);
+
+#endif
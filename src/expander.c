@@ -0,0 +1,118 @@
+#include "expander.h"
+#include "max6675.h"
+#include "systime.h"
+
+// A MAX6675 read is one 16 bit frame, 16 / 3MHz = 5.3us at the SPI1
+// prescaler, plus the DMA interrupt. Ten frames is plenty
+#define EXPANDER_BUSY_WAIT_US 50
+
+static uint32_t bitmap;			// wanted outputs
+static uint32_t shown = UINT32_MAX; // latched outputs, forces the first flush
+
+void expander_init(void)
+{
+	RCC->APB2PCENR |= RCC_APB2Periph_GPIOC;
+
+	EXPANDER_LATCH_PORT->CFGLR &= ~(0xf << (4 * EXPANDER_LATCH_PIN));
+	EXPANDER_LATCH_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP) << (4 * EXPANDER_LATCH_PIN);
+	EXPANDER_LATCH_PORT->BCR = 1 << EXPANDER_LATCH_PIN;
+
+#ifdef MAX6675_USE_SPI_DMA
+	// MOSI (PC6) as alternate function push-pull, SPI1 is already running
+	EXPANDER_MOSI_PORT->CFGLR &= ~(0xf << (4 * EXPANDER_MOSI_PIN));
+	EXPANDER_MOSI_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF) << (4 * EXPANDER_MOSI_PIN);
+#else
+	EXPANDER_MOSI_PORT->CFGLR &= ~(0xf << (4 * EXPANDER_MOSI_PIN));
+	EXPANDER_MOSI_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP) << (4 * EXPANDER_MOSI_PIN);
+#endif
+
+	bitmap = 0;
+	expander_flush();
+}
+
+void expander_set(uint8_t output, bool on)
+{
+	if (output >= EXPANDER_OUTPUTS)
+	{
+		return;
+	}
+	if (on)
+	{
+		bitmap |= 1UL << output;
+	}
+	else
+	{
+		bitmap &= ~(1UL << output);
+	}
+}
+
+#ifdef MAX6675_USE_SPI_DMA
+
+// SPI1 runs 16 bit frames for the MAX6675. Whole frames are sent, an odd
+// byte count gets a padding byte first, which falls off the end of the chain
+static void shift_out(uint32_t bits)
+{
+	const uint8_t frames = (EXPANDER_BYTES + 1) / 2;
+
+	for (int8_t i = frames - 1; i >= 0; i--)
+	{
+		SPI1->DATAR = bits >> (16 * i);
+		// RXNE is set once the whole frame is out, reading it keeps the
+		// receive side clean for the next sensor read
+		while (!(SPI1->STATR & SPI_STATR_RXNE))
+			;
+		(void)SPI1->DATAR;
+	}
+}
+
+#else
+
+static void shift_out(uint32_t bits)
+{
+	for (int8_t i = EXPANDER_BYTES * 8 - 1; i >= 0; i--)
+	{
+		if (bits & (1UL << i))
+		{
+			EXPANDER_MOSI_PORT->BSHR = 1 << EXPANDER_MOSI_PIN;
+		}
+		else
+		{
+			EXPANDER_MOSI_PORT->BCR = 1 << EXPANDER_MOSI_PIN;
+		}
+		MAX6675_SCK_PORT->BSHR = 1 << MAX6675_SCK_PIN;
+		Delay_Us(1);
+		MAX6675_SCK_PORT->BCR = 1 << MAX6675_SCK_PIN;
+		Delay_Us(1);
+	}
+}
+
+#endif
+
+bool expander_flush(void)
+{
+	uint32_t bits = bitmap;
+
+	if (bits == shown)
+	{
+		return true;
+	}
+
+	// A sensor read takes a few microseconds, wait it out rather than skip
+	// a control tick
+	uint32_t start = micros();
+	while (max6675_busy())
+	{
+		if (elapsed_us(start) > EXPANDER_BUSY_WAIT_US)
+		{
+			return false;
+		}
+	}
+
+	shift_out(bits);
+
+	// Rising edge on RCLK moves the whole chain to the outputs at once
+	EXPANDER_LATCH_PORT->BSHR = 1 << EXPANDER_LATCH_PIN;
+	EXPANDER_LATCH_PORT->BCR = 1 << EXPANDER_LATCH_PIN;
+	shown = bits;
+	return true;
+}
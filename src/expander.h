@@ -0,0 +1,43 @@
+#ifndef EXPANDER_H
+#define EXPANDER_H
+
+#include "ch32v003fun.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Output expander: chained 74HC595s on the thermocouple bus.
+ * SER -> PC6 (MOSI), SRCLK -> PC5 (SCK), RCLK -> PC4 (latch).
+ * The MAX6675s ignore the bus while their CS is high, and the 595 outputs
+ * only change on the latch edge, so sensor reads clocking junk through the
+ * shift registers do no harm. The whole chain is shifted and then latched
+ * in one go, only when the bitmap changed.
+ */
+#define EXPANDER_BYTES 1 // 595s in the chain, 1 to 4, 8 outputs each
+#define EXPANDER_LATCH_PORT GPIOC
+#define EXPANDER_LATCH_PIN 4
+#define EXPANDER_MOSI_PORT GPIOC
+#define EXPANDER_MOSI_PIN 6
+
+#define EXPANDER_OUTPUTS (EXPANDER_BYTES * 8)
+
+/**
+ * @brief Sets up MOSI and the latch pin, call after max6675_init().
+ * Clears every output.
+ */
+void expander_init(void);
+
+/**
+ * @brief Sets one output in the bitmap, sent on the next flush.
+ * Output 0 is QA of the 595 nearest the MCU.
+ */
+void expander_set(uint8_t output, bool on);
+
+/**
+ * @brief Shifts the bitmap out and latches it, if it changed since the
+ * last flush. Waits for a sensor read in flight to finish first.
+ * @return false if the bus stayed busy, the next flush retries.
+ */
+bool expander_flush(void);
+
+#endif
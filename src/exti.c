@@ -0,0 +1,18 @@
+#include "ch32v003fun.h"
+#include "button.h"
+#include "tach.h"
+
+// EXTI lines 0-7 share one interrupt: the fan tachs and the button
+void EXTI7_0_IRQHandler(void) __attribute__((interrupt));
+void EXTI7_0_IRQHandler(void)
+{
+	uint32_t now = SysTick->CNT;
+	uint32_t pending = EXTI->INTFR;
+
+	EXTI->INTFR = pending;
+	tach_edge(pending, now);
+	if (pending & (1 << BUTTON_PIN))
+	{
+		button_edge();
+	}
+}
@@ -0,0 +1,55 @@
+#include "fan.h"
+
+#define FAN_PWM_TOP (FAN_DUTY_MAX - 1)
+// Rounded to the nearest prescaler, ~23kHz at 48MHz
+#define FAN_PWM_PSC ((FUNCONF_SYSTEM_CORE_CLOCK + FAN_PWM_HZ * (FAN_DUTY_MAX / 2)) / (FAN_PWM_HZ * FAN_DUTY_MAX) - 1)
+
+// Compare register of each fan, in fan order
+static volatile uint32_t *const fan_ccr[FAN_COUNT] = {&TIM1->CH3CVR, &TIM1->CH1CVR};
+
+void fan_init(void)
+{
+	RCC->APB2PCENR |= RCC_APB2Periph_GPIOD | RCC_APB2Periph_TIM1 | RCC_APB2Periph_AFIO;
+
+	// Default mapping, CH1 on PD2 and CH3N on PD1
+	AFIO->PCFR1 &= ~AFIO_PCFR1_TIM1_REMAP;
+
+	// PD1 and PD2 as alternate function push-pull
+	GPIOD->CFGLR &= ~((0xF << (4 * 1)) | (0xF << (4 * 2)));
+	GPIOD->CFGLR |= ((GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF) << (4 * 1)) |
+					((GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF) << (4 * 2));
+
+	// Reset Timer1
+	RCC->APB2PRSTR |= RCC_APB2Periph_TIM1;
+	RCC->APB2PRSTR &= ~RCC_APB2Periph_TIM1;
+
+	TIM1->PSC = FAN_PWM_PSC;
+	TIM1->ATRLR = FAN_PWM_TOP;
+
+	// PWM mode 1 with preload, so a new duty waits for the period to end
+	TIM1->CHCTLR1 = TIM_OC1M_2 | TIM_OC1M_1 | TIM_OC1PE;
+	TIM1->CHCTLR2 = TIM_OC3M_2 | TIM_OC3M_1 | TIM_OC3PE;
+	TIM1->CH1CVR = 0;
+	TIM1->CH3CVR = 0;
+
+	// With CC3E off, CH3N follows the OC3 reference as is
+	TIM1->CCER = TIM_CC1E | TIM_CC3NE;
+	TIM1->BDTR = TIM_MOE;
+
+	TIM1->SWEVGR = TIM_UG;
+	TIM1->CTLR1 = TIM_ARPE | TIM_CEN;
+}
+
+void fan_set_duty(uint8_t fan, uint16_t duty)
+{
+	if (duty > FAN_DUTY_MAX)
+	{
+		duty = FAN_DUTY_MAX;
+	}
+	*fan_ccr[fan] = duty;
+}
+
+uint16_t fan_duty(uint8_t fan)
+{
+	return *fan_ccr[fan];
+}
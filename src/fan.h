@@ -0,0 +1,44 @@
+#ifndef FAN_H
+#define FAN_H
+
+#include "ch32v003fun.h"
+#include <stdint.h>
+
+/*
+ * Fan outputs on TIM1 with the default mapping: FAN1 on PD1 (CH3N) and
+ * FAN2 on PD2 (CH1). CH3 itself stays off so PC3 is free for the button.
+ * PWM runs at ~23kHz, inside the 4 wire fan range and above hearing.
+ * A relay driven fan only ever gets 0 or FAN_DUTY_MAX.
+ */
+#define FAN_COUNT 2
+#define FAN_DUTY_MAX 1024 // duty for always on
+#define FAN_PWM_HZ 25000
+
+/**
+ * @brief Sets up TIM1 and both fan pins, fans off.
+ */
+void fan_init(void);
+
+/**
+ * @brief Sets the duty of a fan, 0..FAN_DUTY_MAX. Takes effect on the
+ * next PWM period.
+ */
+void fan_set_duty(uint8_t fan, uint16_t duty);
+
+/**
+ * @brief Returns the duty last set for a fan.
+ */
+uint16_t fan_duty(uint8_t fan);
+
+// Percent to duty and back, by multiply and shift: 1024 / 100 ~ 2621 >> 8
+static inline uint16_t fan_percent_to_duty(uint8_t percent)
+{
+	return ((uint32_t)percent * 2621 + 128) >> 8;
+}
+
+static inline uint8_t fan_duty_to_percent(uint16_t duty)
+{
+	return ((uint32_t)duty * 100 + (FAN_DUTY_MAX >> 1)) >> 10;
+}
+
+#endif
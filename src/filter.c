@@ -0,0 +1,56 @@
+#include "filter.h"
+
+void filter_reset(TempFilter *filter)
+{
+	filter->count = 0;
+	filter->next = 0;
+}
+
+static temp_q2_t median3(temp_q2_t a, temp_q2_t b, temp_q2_t c)
+{
+	if (a > b)
+	{
+		temp_q2_t t = a;
+		a = b;
+		b = t;
+	}
+	// a <= b now, the median is b clamped to c from below and above
+	if (c < a)
+	{
+		return a;
+	}
+	if (c > b)
+	{
+		return b;
+	}
+	return c;
+}
+
+temp_q2_t filter_update(TempFilter *filter, temp_q2_t sample, uint8_t shift)
+{
+	filter->window[filter->next] = sample;
+	filter->next = filter->next == 2 ? 0 : filter->next + 1;
+
+	// Until the window fills the newest sample is all there is
+	if (filter->count < 3)
+	{
+		if (filter->count++ == 0)
+		{
+			filter->average = (int32_t)sample << FILTER_FRAC;
+		}
+	}
+	else
+	{
+		sample = median3(filter->window[0], filter->window[1], filter->window[2]);
+	}
+
+	if (shift > FILTER_SHIFT_MAX)
+	{
+		shift = FILTER_SHIFT_MAX;
+	}
+	int32_t x = (int32_t)sample << FILTER_FRAC;
+	filter->average += (x - filter->average) >> shift;
+
+	// Round back to 0.25C
+	return (filter->average + (1 << (FILTER_FRAC - 1))) >> FILTER_FRAC;
+}
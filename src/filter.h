@@ -0,0 +1,45 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "temperature.h"
+#include <stdint.h>
+
+/*
+ * Streaming filter for one sensor: a median of the last 3 samples throws
+ * out single sample spikes, then an exponential moving average smooths the
+ * rest. The average keeps FILTER_FRAC extra bits so small steps are not
+ * lost to rounding and the output stays at full 0.25C resolution. Fixed
+ * size state, no divides, hardware free.
+ *
+ * The step (x - average) >> shift truncates to nothing once the error is
+ * under 2^shift, so FILTER_FRAC must be at least FILTER_SHIFT_MAX: then
+ * that leftover is under a quarter of a 0.25C step and the output settles
+ * on a constant input exactly, from above or below.
+ */
+#define FILTER_FRAC 8
+#define FILTER_SHIFT_MAX 6 // alpha = 1 / 2^shift, 0 turns the average off
+
+#if FILTER_FRAC < FILTER_SHIFT_MAX
+#error FILTER_FRAC must be at least FILTER_SHIFT_MAX
+#endif
+
+typedef struct
+{
+	temp_q2_t window[3]; // last samples, for the median
+	uint8_t count;		 // samples in the window, up to 3
+	uint8_t next;		 // window slot of the next sample
+	int32_t average;	 // scaled by 1 << FILTER_FRAC
+} TempFilter;
+
+/**
+ * @brief Empties the filter, the next sample passes straight through.
+ */
+void filter_reset(TempFilter *filter);
+
+/**
+ * @brief Adds a sample and returns the filtered value.
+ * @param shift EMA coefficient, alpha = 1 / 2^shift.
+ */
+temp_q2_t filter_update(TempFilter *filter, temp_q2_t sample, uint8_t shift);
+
+#endif
@@ -0,0 +1,129 @@
+#include "format.h"
+
+// Right aligns the text from start in width, moving it along in place
+static char *fmt_align(char *start, char *end, uint8_t width, char pad)
+{
+	uint8_t len = end - start;
+
+	if (len >= width)
+	{
+		return end;
+	}
+
+	uint8_t shift = width - len;
+	for (uint8_t i = len; i-- > 0;)
+	{
+		start[i + shift] = start[i];
+	}
+	for (uint8_t i = 0; i < shift; i++)
+	{
+		start[i] = pad;
+	}
+	end += shift;
+	*end = '\0';
+	return end;
+}
+
+// Digits only, no padding
+static char *fmt_digits(char *buf, uint16_t value)
+{
+	static const uint16_t powers[] = {10000, 1000, 100, 10};
+	bool started = false;
+
+	// Count down each power of ten instead of dividing
+	for (uint8_t i = 0; i < sizeof(powers) / sizeof(powers[0]); i++)
+	{
+		char digit = '0';
+		while (value >= powers[i])
+		{
+			value -= powers[i];
+			digit++;
+		}
+		if (started || digit != '0')
+		{
+			*buf++ = digit;
+			started = true;
+		}
+	}
+	*buf++ = '0' + value;
+	*buf = '\0';
+	return buf;
+}
+
+char *fmt_char(char *buf, char c)
+{
+	*buf++ = c;
+	*buf = '\0';
+	return buf;
+}
+
+char *fmt_str(char *buf, const char *str)
+{
+	while (*str)
+	{
+		*buf++ = *str++;
+	}
+	*buf = '\0';
+	return buf;
+}
+
+char *fmt_pad(char *start, char *end, uint8_t width)
+{
+	while (end - start < width)
+	{
+		*end++ = ' ';
+	}
+	*end = '\0';
+	return end;
+}
+
+char *fmt_uint(char *buf, uint16_t value, uint8_t width, char pad)
+{
+	return fmt_align(buf, fmt_digits(buf, value), width, pad);
+}
+
+char *fmt_int(char *buf, int16_t value, uint8_t width, char pad)
+{
+	if (value >= 0)
+	{
+		return fmt_uint(buf, value, width, pad);
+	}
+
+	// The magnitude of -32768 still fits in 16 bits unsigned
+	uint16_t mag = -(int32_t)value;
+	if (pad == '0')
+	{
+		*buf = '-';
+		return fmt_uint(buf + 1, mag, width ? width - 1 : 0, '0');
+	}
+	char *end = fmt_digits(fmt_char(buf, '-'), mag);
+	return fmt_align(buf, end, width, pad);
+}
+
+char *fmt_temp(char *buf, temp_q2_t t, bool fraction, uint8_t width)
+{
+	static const char quarters[4][3] = {"00", "25", "50", "75"};
+	char *p = buf;
+
+	if (!fraction)
+	{
+		return fmt_int(buf, temp_round(t), width, ' ');
+	}
+
+	if (t < 0)
+	{
+		// -INT16_MIN does not fit, the lowest shown is -8191.75
+		if (t < -INT16_MAX)
+		{
+			t = -INT16_MAX;
+		}
+		*p++ = '-';
+		t = -t;
+	}
+	p = fmt_digits(p, t >> 2);
+	*p++ = '.';
+	*p++ = quarters[t & 3][0];
+	*p++ = quarters[t & 3][1];
+	*p = '\0';
+	return fmt_align(buf, p, width, ' ');
+}
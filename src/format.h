@@ -0,0 +1,61 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "temperature.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Display text without printf. Numbers are built by counting down powers
+ * of ten, so nothing divides on the rv32ec core and mini_vpprintf never
+ * gets linked in. Every call writes a terminating null and returns a
+ * pointer to it, so calls chain by passing the result on:
+ *
+ *     p = fmt_str(buf, "T1:");
+ *     p = fmt_uint(p, setpoint, 3, ' ');
+ *     p = fmt_char(p, FMT_DEGREE);
+ *
+ * width pads on the left with pad (' ' or '0') up to that many characters,
+ * 0 is no padding. Values wider than width are written in full.
+ */
+#define FMT_DEGREE ((char)223) // degree sign in the HD44780 character ROM
+
+// Longest number from fmt_uint()/fmt_int() without padding, "-32768"
+#define FMT_INT_LEN 6
+
+/**
+ * @brief Writes one character.
+ */
+char *fmt_char(char *buf, char c);
+
+/**
+ * @brief Copies a string.
+ */
+char *fmt_str(char *buf, const char *str);
+
+/**
+ * @brief Pads with spaces on the right until the text from start is width
+ * long, for left aligned columns.
+ * @param start Start of the text.
+ * @param end End of the text, as returned by the last call.
+ */
+char *fmt_pad(char *start, char *end, uint8_t width);
+
+/**
+ * @brief Writes an unsigned integer in decimal.
+ */
+char *fmt_uint(char *buf, uint16_t value, uint8_t width, char pad);
+
+/**
+ * @brief Writes a signed integer in decimal, the sign goes before zero
+ * padding and after space padding.
+ */
+char *fmt_int(char *buf, int16_t value, uint8_t width, char pad);
+
+/**
+ * @brief Writes a temperature, space padded.
+ * @param fraction true for ".00/.25/.50/.75", false rounds to whole degrees.
+ */
+char *fmt_temp(char *buf, temp_q2_t t, bool fraction, uint8_t width);
+
+#endif
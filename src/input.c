@@ -0,0 +1,52 @@
+#include "input.h"
+
+#define INPUT_MASK (INPUT_QUEUE_LEN - 1)
+
+#if (INPUT_QUEUE_LEN & INPUT_MASK) || INPUT_QUEUE_LEN > 128
+#error INPUT_QUEUE_LEN must be a power of two up to 128
+#endif
+
+// Keeps the compiler from moving the slot access across the index update.
+// One core and no cache, so ordering the compiler output is all it takes
+#define INPUT_BARRIER() __asm__ volatile("" ::: "memory")
+
+bool input_put(InputQueue *queue, uint8_t type, uint8_t code, int16_t value, uint32_t time)
+{
+	uint8_t head = queue->head;
+
+	if ((uint8_t)(head - queue->tail) >= INPUT_QUEUE_LEN)
+	{
+		if (queue->overflows != UINT16_MAX)
+		{
+			queue->overflows++;
+		}
+		return false;
+	}
+
+	InputEvent *event = &queue->events[head & INPUT_MASK];
+	event->type = type;
+	event->code = code;
+	event->value = value;
+	event->time = time;
+
+	INPUT_BARRIER();
+	queue->head = head + 1;
+	return true;
+}
+
+bool input_get(InputQueue *queue, InputEvent *event)
+{
+	uint8_t tail = queue->tail;
+
+	if (tail == queue->head)
+	{
+		return false;
+	}
+
+	INPUT_BARRIER();
+	*event = queue->events[tail & INPUT_MASK];
+
+	INPUT_BARRIER();
+	queue->tail = tail + 1;
+	return true;
+}
@@ -0,0 +1,63 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Single producer, single consumer ring of typed input events.
+ * The producer only writes head and the consumer only writes tail, both
+ * count freely and wrap, and the slot is filled before head moves past
+ * it. So an interrupt can produce while the main loop consumes, or the
+ * other way round, with no interrupts masked on either side. Producers
+ * that can interrupt one another must not share a queue, nor may consumers.
+ *
+ * A full queue drops the new event and counts it in overflows.
+ */
+#define INPUT_QUEUE_LEN 16 // power of two, at most 128
+
+typedef enum
+{
+	INPUT_NONE,
+	INPUT_ENCODER, // value: detents, code: acceleration shift
+	INPUT_BUTTON,  // code: button_event_t
+	INPUT_EDGE,	   // code: 1 pressed, 0 released
+} input_type_t;
+
+typedef struct
+{
+	uint8_t type;
+	uint8_t code;
+	int16_t value;
+	uint32_t time; // millis() when it happened
+} InputEvent;
+
+typedef struct
+{
+	InputEvent events[INPUT_QUEUE_LEN];
+	volatile uint8_t head;		 // next slot to fill, producer only
+	volatile uint8_t tail;		 // next slot to take, consumer only
+	volatile uint16_t overflows; // events dropped on a full queue, producer only
+} InputQueue;
+
+/**
+ * @brief Adds an event, producer side.
+ * @return false if the queue was full and the event was dropped.
+ */
+bool input_put(InputQueue *queue, uint8_t type, uint8_t code, int16_t value, uint32_t time);
+
+/**
+ * @brief Takes the oldest event, consumer side.
+ * @return false if the queue was empty.
+ */
+bool input_get(InputQueue *queue, InputEvent *event);
+
+/**
+ * @brief Number of events waiting, from either side.
+ */
+static inline uint8_t input_count(const InputQueue *queue)
+{
+	return (uint8_t)(queue->head - queue->tail);
+}
+
+#endif
@@ -25,9 +25,16 @@ TEMP SENSORs:
 	MOSI -> PC6
 	MISO -> PC7
 	CS sensor1 -> PD0
-RELAYS:
+	CS sensor2 -> PC0
+FANS (relay or PWM, TIM1):
 	FAN1 -> PD1
 	FAN2 -> PD2
+	TACH1 -> PD5
+	TACH2 -> PD6
+74HC595 EXPANDER (optional, on the sensor bus):
+	SER -> PC6
+	SRCLK -> PC5
+	RCLK -> PC4
 
 
 */
@@ -35,23 +42,31 @@ RELAYS:
 #include "ch32v003fun.h"
 #include "funconfig.h"
 #include "../lib/lcd_i2c.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
+#include "scheduler.h"
+#include "systime.h"
+#include "sensors.h"
+#include "temperature.h"
+#include "settings.h"
+#include "fan.h"
+#include "pid.h"
+#include "autotune.h"
+#include "trend.h"
+#include "tach.h"
+#include "staging.h"
+#include "expander.h"
+#include "button.h"
+#include "input.h"
+#include "menu.h"
+#include "format.h"
 
-#define TICK_NS 120
 #define PULSES_PER_DETENT 4
-#define BUTTON_PIN GPIO_Pin_3
-#define DEBOUNCE_TIME 50	// Debounce time in milliseconds
 #define SCREEN_TIMOUT 10000 // Screen timeout in milliseconds
-#define SCK_PORT GPIOC
-#define SCK_PIN 5 // PC5 for clock
-#define MISO_PORT GPIOC
-#define MISO_PIN 7 // PC7 for data
-#define CS1_PORT GPIOD
-#define CS1_PIN 0 // PD0 for first CS
-#define FAN_1 1
-#define FAN_2 2
+#define INPUT_PERIOD 5	// Task periods in milliseconds
+#define FAN_PERIOD 1000
+#define DISPLAY_PERIOD 20
+#define FAN_SPINUP_MS 3000 // time a fan gets to spin up before it can stall
+#define FAN_HYSTERESIS TEMP_Q2(1) // relay fans switch off this far under the setpoint
+#define FAN_DWELL_MS 30000		  // relay fans stay on or off at least this long
 
 // Menu states
 typedef enum
@@ -61,210 +76,298 @@ typedef enum
 	EDITING_VALUE
 } MenuState;
 
-// Menu items
-typedef enum
-{
-	SET_TEMP1,
-	SET_TEMP2,
-	SET_UNITS,
-	EXIT,
-	MENU_ITEMS_COUNT
-} MenuItem;
-
 // Global variables
 MenuState currentState = DISPLAYING_DATA;
-MenuItem selectedMenuItem = SET_TEMP1;
-int menuOffset = 0;
-const int MENU_DISPLAY_LINES = 4;
-bool fahrenheit = true;
+uint8_t fahrenheit = 1;
 char units[3] = "F";
-uint8_t fan1_state = 0;
-uint8_t fan2_state = 0;
-uint8_t counter;
 
 // I2C LCD settings
 int lcd_address = 0x27;
 uint32_t i2c_clk_rate = 400000;
 
-// Settings variables
-int temperature1 = 80;
-int temperature2 = 90;
-uint16_t sensor1Value = 0;
-uint16_t sensor2Value = 0;
-uint32_t last_sensor_check = 0;
-
-// Button handling
+// Settings, the menu edits them in place
+Settings settings;
+
+// Fan control, one loop per fan sharing the tuning in settings
+PidConfig fanPidConfig;
+PidState fanPid[FAN_COUNT];
+AutoTune fanTune; // drives both fans while running
+
+// Relay mode look ahead, from the sensor 1 trend
+Trend fanTrend;
+uint32_t trendStamp;	 // timestamp of the last sample added
+temp_q2_t overshootPeak; // highest 0.25C over setpoint 1 so far, 0 when below
+temp_q2_t fanOvershoot;	 // peak of the last finished excursion
+
+// Relay mode fans, one stage each. Thresholds follow the setpoints
+void fanSwitch(uint8_t fan, bool on);
+Stage fanStages[] = {
+	{.sensor = 0, .dwell_ms = FAN_DWELL_MS, .output = fanSwitch, .channel = 0},
+	{.sensor = 0, .dwell_ms = FAN_DWELL_MS, .output = fanSwitch, .channel = 1},
+};
+#define FAN_STAGES (sizeof(fanStages) / sizeof(fanStages[0]))
+bool fanAhead;			// fanProjected is valid
+temp_q2_t fanProjected; // sensor 1 trend at the look ahead time
+
+// Stall detection from the tachometers
+uint32_t fanOffTime[FAN_COUNT]; // last time the fan was not driven
+bool fanStalled[FAN_COUNT];
+
+// Input handling, everything here is only touched from the main loop.
+// The button interrupt talks to it through queues only
+InputQueue inputQueue;			  // encoder and button events for the UI
 uint32_t lastInteractionTime = 0; // for screen timeout
-volatile uint32_t lastButtonPress = 0;
-volatile uint8_t buttonPressed = 0;
-volatile bool backlight_state = 1;
+bool backlight_state = 1;
+bool displayDirty = true; // set to redraw the LCD on the next display task
+bool valueDirty;		  // the value field was redrawn, flush it now
 
 // Encoder variables
-volatile int oldPos = 0;
-uint16_t initial_count;
+uint16_t encoderCount;	 // TIM2 count at the last poll
+int16_t encoderPulses;	 // pulses not yet making up a whole detent
+uint32_t encoderMoveTime; // last time the knob moved a detent
+
+// Faster spins move values further: the step doubles per row while the
+// knob turns a detent in less than ms
+static const struct
+{
+	uint8_t ms;
+	uint8_t shift;
+} encoderAccel[] = {
+	{15, 3},
+	{30, 2},
+	{60, 1},
+};
 
 // Function prototypes
 void timer2_encoder_init(void);
-const char *getMenuItemText(MenuItem item);
 void updateMenu(uint8_t lcd_address);
-void handleEncoder(uint8_t lcd_address, int32_t position);
-void readSensors(void);
-uint8_t checkButton(void);
-uint32_t get_Time(void);
+void handleEncoder(uint8_t lcd_address, int16_t detents, int16_t step);
+temp_q2_t sensorTemp(uint8_t index);
 
-void setup_temp_sensor(void)
+// Latest reading of a sensor in quarter degrees of the selected units,
+// 0 while the sensor is faulted
+temp_q2_t sensorTemp(uint8_t index)
 {
-	// Enable GPIO ports
-	RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_GPIOD;
-
-	// Configure SCK (PC5) as output
-	SCK_PORT->CFGLR &= ~(0xf << (4 * SCK_PIN));
-	SCK_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP) << (4 * SCK_PIN);
-
-	// Configure MISO (PC7) as input floating
-	MISO_PORT->CFGLR &= ~(0xf << (4 * MISO_PIN));
-	MISO_PORT->CFGLR |= GPIO_CNF_IN_FLOATING << (4 * MISO_PIN);
-
-	// Configure CS1 (PD0) as output
-	CS1_PORT->CFGLR &= ~(0xf << (4 * CS1_PIN));
-	CS1_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP) << (4 * CS1_PIN);
+	Sensor *sensor = &sensors[index];
 
-	// Set initial states
-	SCK_PORT->OUTDR &= ~(1 << SCK_PIN); // SCK starts low
-	CS1_PORT->OUTDR |= (1 << CS1_PIN);	// CS1 starts high
-
-	Delay_Ms(1); // Short delay after setup
+	if (sensor->fault)
+	{
+		return 0;
+	}
+	if (fahrenheit)
+	{
+		return temp_c_to_f(sensor->temp_c4);
+	}
+	return sensor->temp_c4;
 }
 
-// BITTY BITTY BANG BANG !!!
-uint16_t read_single_sensor(GPIO_TypeDef *cs_port, uint8_t cs_pin)
+// Loads settings into the fan loops and the sensor filters
+void applySettings(void)
 {
-	uint16_t raw_value = 0;
-
-	cs_port->OUTDR |= (1 << cs_pin);
-	Delay_Us(50);
+	fanPidConfig.kp = settings.kp;
+	fanPidConfig.ki = settings.ki;
+	fanPidConfig.kd = settings.kd;
+	fanPidConfig.out_min = fan_percent_to_duty(settings.min_duty);
+	fanPidConfig.out_max = fan_percent_to_duty(settings.max_duty);
+	sensors_set_filter(settings.filter);
+}
 
-	cs_port->OUTDR &= ~(1 << cs_pin);
-	Delay_Us(50);
+// A setpoint in the selected units as 0.25C, the unit the fan loops use
+temp_q2_t setpointC4(int setpoint)
+{
+	temp_q2_t target = TEMP_Q2(setpoint);
 
-	for (int i = 15; i >= 0; i--)
+	if (fahrenheit)
 	{
-		SCK_PORT->OUTDR &= ~(1 << SCK_PIN);
-		Delay_Us(10);
-
-		if (MISO_PORT->INDR & (1 << MISO_PIN))
-		{
-			raw_value |= (1 << i);
-		}
-
-		SCK_PORT->OUTDR |= (1 << SCK_PIN);
-		Delay_Us(10);
+		target = temp_f_to_c(target);
 	}
+	return target;
+}
 
-	cs_port->OUTDR |= (1 << cs_pin);
-	Delay_Us(50);
+// Short name of the fault that failed a sensor, or of its warning
+const char *sensorState(uint8_t index)
+{
+	uint8_t fault = sensors[index].fault;
+
+	if (fault & SENSOR_FAULT_OPEN)
+		return "OPEN";
+	if (fault & SENSOR_FAULT_NO_DEVICE)
+		return "NODEV";
+	if (fault & SENSOR_FAULT_SHORT)
+		return "SHORT";
+	if (fault & SENSOR_FAULT_JUMP)
+		return "JUMP";
+	if (fault & SENSOR_FAULT_NO_DATA)
+		return "WAIT";
+	if (sensors[index].warning & SENSOR_WARN_STUCK)
+		return "STUCK";
+	return "OK";
+}
 
-	return raw_value;
+// Menu value formatters, see MenuEntry
+char *formatNumber(char *buf, uint8_t value)
+{
+	return fmt_uint(buf, value, 0, ' ');
 }
 
-void readSensors()
+char *formatDegrees(char *buf, uint8_t value)
 {
-	char debug_buf[32];
-	uint16_t raw1 = 0;
+	return fmt_char(fmt_uint(buf, value, 0, ' '), FMT_DEGREE);
+}
 
-	raw1 = read_single_sensor(CS1_PORT, CS1_PIN);
+char *formatPercent(char *buf, uint8_t value)
+{
+	return fmt_char(fmt_uint(buf, value, 0, ' '), '%');
+}
 
-	// Process readings
-	if (!(raw1 & 0x4))
-	{
-		sensor1Value = (raw1 >> 3) / 4;
-		if (fahrenheit)
-		{
-			sensor1Value = (sensor1Value * 9.0 / 5.0) + 32;
-		}
-		else
-		{
-			sensor1Value = sensor1Value;
-		}
-	}
-	else
-	{
-		sensor1Value = 0;
-	}
+char *formatSeconds(char *buf, uint8_t value)
+{
+	return fmt_char(fmt_uint(buf, value, 0, ' '), 's');
+}
 
-	// debug output
-	// LCD_SetCursor(0x27, 0, 3);
-	// sprintf(debug_buf, "S1:%d%s", sensor1Value,units);
-	// LCD_WriteString(0x27, debug_buf);
+char *formatUnits(char *buf, uint8_t value)
+{
+	return fmt_char(buf, value ? 'F' : 'C');
 }
 
-// simulated EEPROM with optinbytes
-// Settings structure to pack/unpack from Option bytes
-typedef struct
+char *formatFanMode(char *buf, uint8_t value)
 {
-	uint8_t temperature1; // First temperature threshold
-	uint8_t temperature2; // Second temperature threshold
-	uint8_t reserved : 4; // Reserved for future use
-} Settings;
+	return fmt_str(buf, value ? "PWM" : "Relay");
+}
 
-void FlashOptionData(uint8_t data0, uint8_t data1)
+void unitsChanged(void)
 {
-	volatile uint16_t hold[6];
-	uint32_t *hold32p = (uint32_t *)hold;
-	uint32_t *ob32p = (uint32_t *)OB_BASE;
+	units[0] = fahrenheit ? 'F' : 'C';
+}
 
-	// Save current Option bytes
-	hold32p[0] = ob32p[0];				// Copy RDPR and USER
-	hold32p[1] = data0 + (data1 << 16); // Copy in the two Data values to be written
-	hold32p[2] = ob32p[2];				// Copy WRPR0 and WEPR1
+// Relay mode only, 0 is off. The last overshoot past setpoint 1 shows
+// how well the current value works
+void drawOvershoot(void)
+{
+	char buf[LCD_COLS + 1];
+	temp_q2_t overshoot = fanOvershoot;
 
-	// Unlock Flash and Option bytes
-	FLASH->KEYR = FLASH_KEY1;
-	FLASH->KEYR = FLASH_KEY2;
-	FLASH->OBKEYR = FLASH_KEY1;
-	FLASH->OBKEYR = FLASH_KEY2;
+	if (fahrenheit)
+	{
+		overshoot = temp_c_to_f(overshoot) - TEMP_Q2(32);
+	}
+	char *p = fmt_str(buf, "Overshoot ");
+	p = fmt_temp(p, overshoot, true, 0);
+	fmt_str(p, units);
+	LCD_FrameSetCursor(0, 2);
+	LCD_FrameWriteString(buf);
+}
 
-	// Erase Option bytes
-	FLASH->CTLR |= CR_OPTER_Set;
-	FLASH->CTLR |= CR_STRT_Set;
-	while (FLASH->STATR & FLASH_BUSY)
-		;
-	FLASH->CTLR &= CR_OPTER_Reset;
+// One row per sensor: state and how many times it went bad
+void drawSensorStatus(void)
+{
+	char buf[LCD_COLS + 1];
 
-	// Write back values
-	FLASH->CTLR |= CR_OPTPG_Set;
-	uint16_t *ob16p = (uint16_t *)OB_BASE;
-	for (int i = 0; i < sizeof(hold) / sizeof(hold[0]); i++)
+	for (uint8_t i = 0; i < SENSOR_COUNT && i < LCD_ROWS; i++)
 	{
-		ob16p[i] = hold[i];
-		while (FLASH->STATR & FLASH_BUSY)
-			;
+		char *p = fmt_char(buf, 'S');
+		p = fmt_char(p, '1' + i);
+		p = fmt_char(p, ' ');
+		p = fmt_pad(p, fmt_str(p, sensorState(i)), 5);
+		p = fmt_str(p, " F:");
+		fmt_uint(p, sensors[i].faults, 0, ' ');
+		LCD_FrameSetCursor(0, i);
+		LCD_FrameWriteString(buf);
 	}
-
-	FLASH->CTLR &= CR_OPTPG_Reset;
-	FLASH->CTLR |= CR_LOCK_Set;
 }
 
-// Function to save all settings
-void SaveSettings(Settings *settings)
+void drawAutotune(void)
 {
-	// Pack settings into data0
-	uint8_t data0 = settings->temperature1;
+	char buf[LCD_COLS + 1];
+	char *p;
 
-	// Pack settings into data1
-	uint8_t data1 = settings->temperature2 & 0xFF;
+	LCD_FrameSetCursor(0, 0);
+	LCD_FrameWriteString("Auto Tune at T1:");
+	LCD_FrameSetCursor(0, 1);
+	switch (fanTune.state)
+	{
+	case AUTOTUNE_RUNNING:
+		p = fmt_str(buf, "> Cycle ");
+		p = fmt_uint(p, autotune_cycle(&fanTune), 0, ' ');
+		p = fmt_str(p, " of ");
+		fmt_uint(p, AUTOTUNE_CYCLES, 0, ' ');
+		LCD_FrameWriteString(buf);
+		LCD_FrameSetCursor(0, 2);
+		LCD_FrameWriteString("  Turn to abort");
+		break;
+	case AUTOTUNE_DONE:
+		p = fmt_str(buf, "> P");
+		p = fmt_uint(p, settings.kp, 0, ' ');
+		p = fmt_str(p, " I");
+		p = fmt_uint(p, settings.ki, 0, ' ');
+		p = fmt_str(p, " D");
+		fmt_uint(p, settings.kd, 0, ' ');
+		LCD_FrameWriteString(buf);
+		break;
+	case AUTOTUNE_FAILED:
+		LCD_FrameWriteString("> Failed");
+		break;
+	default:
+		break;
+	}
+}
 
-	FlashOptionData(data0, data1);
+void tuneStart(void)
+{
+	if (fanTune.state != AUTOTUNE_RUNNING && !sensors[0].fault)
+	{
+		autotune_start(&fanTune, setpointC4(settings.temperature1), fanPidConfig.out_max, millis());
+	}
 }
 
-// Function to load all settings
-void LoadSettings(Settings *settings)
+void tuneAbort(void)
 {
-	// Read from Option bytes
-	settings->temperature1 = OB->Data0;
-	settings->temperature2 = OB->Data1 & 0xFF;
+	autotune_abort(&fanTune);
 }
 
+// Menu pages. A new setting is one more row here
+const MenuEntry tuningEntries[] = {
+	{.label = "Fan Gain P", .type = MENU_NUMBER, .flags = MENU_PERSIST, .max = 255, .step = 1,
+	 .value = &settings.kp, .format = formatNumber, .changed = applySettings},
+	{.label = "Fan Gain I", .type = MENU_NUMBER, .flags = MENU_PERSIST, .max = 255, .step = 1,
+	 .value = &settings.ki, .format = formatNumber, .changed = applySettings},
+	{.label = "Fan Gain D", .type = MENU_NUMBER, .flags = MENU_PERSIST, .max = 255, .step = 1,
+	 .value = &settings.kd, .format = formatNumber, .changed = applySettings},
+	// Duty limits are percent and must not cross
+	{.label = "Fan Min Duty", .type = MENU_NUMBER, .flags = MENU_PERSIST | MENU_BOUND_MAX, .step = 1,
+	 .value = &settings.min_duty, .bound = &settings.max_duty, .format = formatPercent, .changed = applySettings},
+	{.label = "Fan Max Duty", .type = MENU_NUMBER, .flags = MENU_PERSIST | MENU_BOUND_MIN, .max = SETTINGS_DUTY_MAX, .step = 1,
+	 .value = &settings.max_duty, .bound = &settings.min_duty, .format = formatPercent, .changed = applySettings},
+	{.label = "Fan Lookahead", .type = MENU_NUMBER, .flags = MENU_PERSIST, .max = 255, .step = 1,
+	 .value = &settings.lookahead, .format = formatSeconds, .draw = drawOvershoot},
+	// Tuning rewrites the gains
+	{.label = "Fan Auto Tune", .type = MENU_SCREEN, .flags = MENU_PERSIST,
+	 .draw = drawAutotune, .enter = tuneStart, .changed = tuneAbort},
+	{.label = "Back", .type = MENU_BACK},
+};
+
+const MenuPage tuningMenu = {tuningEntries, sizeof(tuningEntries) / sizeof(tuningEntries[0])};
+
+const MenuEntry mainEntries[] = {
+	{.label = "Set Temp 1", .type = MENU_NUMBER, .flags = MENU_PERSIST, .max = 255, .step = 1,
+	 .value = &settings.temperature1, .format = formatDegrees},
+	{.label = "Set Temp 2", .type = MENU_NUMBER, .flags = MENU_PERSIST, .max = 255, .step = 1,
+	 .value = &settings.temperature2, .format = formatDegrees},
+	{.label = "Set Units", .type = MENU_FLAG, .max = 1,
+	 .value = &fahrenheit, .format = formatUnits, .changed = unitsChanged},
+	{.label = "Fan 1 Mode", .type = MENU_FLAG, .flags = MENU_PERSIST, .max = SETTINGS_FAN_PWM(0),
+	 .value = &settings.fan_pwm, .format = formatFanMode},
+	{.label = "Fan 2 Mode", .type = MENU_FLAG, .flags = MENU_PERSIST, .max = SETTINGS_FAN_PWM(1),
+	 .value = &settings.fan_pwm, .format = formatFanMode},
+	{.label = "Fan Tuning", .type = MENU_SUBMENU, .page = &tuningMenu},
+	{.label = "Sensor Filter", .type = MENU_NUMBER, .flags = MENU_PERSIST, .max = FILTER_SHIFT_MAX, .step = 1,
+	 .value = &settings.filter, .format = formatNumber, .changed = applySettings},
+	{.label = "Sensor Status", .type = MENU_SCREEN, .draw = drawSensorStatus},
+	{.label = "Exit Menu", .type = MENU_EXIT},
+};
+
+const MenuPage mainMenu = {mainEntries, sizeof(mainEntries) / sizeof(mainEntries[0])};
+
 void timer2_encoder_init(void)
 {
 	// Enable GPIOD, TIM2, and AFIO
@@ -296,265 +399,514 @@ void timer2_encoder_init(void)
 
 	// Set initial count to mid-range
 	TIM2->CNT = 0x8fff;
-	initial_count = TIM2->CNT;
+	encoderCount = TIM2->CNT;
 
 	// Enable Timer2
 	TIM2->CTLR1 |= TIM_CEN;
 }
 
-const char *getMenuItemText(MenuItem item)
-{
-	switch (item)
-	{
-	case SET_TEMP1:
-		return "Set Temp 1";
-	case SET_TEMP2:
-		return "Set Temp 2";
-	case SET_UNITS:
-		return "Set Units";
-	case EXIT:
-		return "Exit Menu";
-	default:
-		return "";
-	}
-}
-
 void updateMenu(uint8_t lcd_address)
 {
-	char buf[16];
 	char temp_buf[16];
 
-	LCD_Clear(lcd_address);
+	LCD_FrameClear();
 
 	switch (currentState)
 	{
 	case IN_MENU:
-		// Adjust menuOffset if selected item would be off screen
-		if (selectedMenuItem < menuOffset)
+		menu_draw_list();
+		break;
+
+	case EDITING_VALUE:
+		menu_draw_edit();
+		break;
+
+	case DISPLAYING_DATA:
+		// First temperature setting
+		LCD_FrameSetCursor(0, 0);
+		fmt_char(fmt_uint(fmt_str(temp_buf, "T1:"), settings.temperature1, 0, ' '), FMT_DEGREE);
+		LCD_FrameWriteString(temp_buf);
+
+		// Display fan states, duty in PWM mode
+		for (uint8_t i = 0; i < FAN_COUNT; i++)
 		{
-			menuOffset = selectedMenuItem;
+			char *p = temp_buf;
+			*p++ = 'F';
+			*p++ = '1' + i;
+			*p++ = ':';
+			if (fanStalled[i])
+			{
+				fmt_str(p, "STALL");
+			}
+			else if (fanTune.state == AUTOTUNE_RUNNING)
+			{
+				fmt_str(p, "TUNE");
+			}
+			else if (settings.fan_pwm & SETTINGS_FAN_PWM(i))
+			{
+				p = fmt_uint(p, fan_duty_to_percent(fan_duty(i)), 0, ' ');
+				fmt_char(p, '%');
+			}
+			else
+			{
+				fmt_str(p, fan_duty(i) ? "ON" : "OFF");
+			}
+			LCD_FrameSetCursor(8, i);
+			LCD_FrameWriteString(temp_buf);
+
+			// Fan speed on the sensor rows, when the fan has a tach
+			if (tach_present(i))
+			{
+				p = fmt_uint(temp_buf, tach_rpm(i), 0, ' ');
+				fmt_str(p, "rpm");
+				LCD_FrameSetCursor(11, 2 + i);
+				LCD_FrameWriteString(temp_buf);
+			}
 		}
-		else if (selectedMenuItem >= menuOffset + MENU_DISPLAY_LINES)
+		// Second temperature setting
+		LCD_FrameSetCursor(0, 1);
+		fmt_char(fmt_uint(fmt_str(temp_buf, "T2:"), settings.temperature2, 0, ' '), FMT_DEGREE);
+		LCD_FrameWriteString(temp_buf);
+
+		// Display sensor readings
+		for (uint8_t i = 0; i < SENSOR_COUNT && i < 2; i++)
 		{
-			menuOffset = selectedMenuItem - MENU_DISPLAY_LINES + 1;
+			char *p = temp_buf;
+			*p++ = 'S';
+			*p++ = '1' + i;
+			*p++ = ':';
+			if (sensors[i].fault)
+			{
+				fmt_str(p, "ERR");
+			}
+			else
+			{
+				p = fmt_temp(p, sensorTemp(i), false, 0);
+				fmt_str(p, units);
+			}
+			LCD_FrameSetCursor(0, 2 + i);
+			LCD_FrameWriteString(temp_buf);
 		}
+		break;
+	}
 
-		// Display visible menu items
-		for (int i = 0; i < MENU_DISPLAY_LINES && (menuOffset + i) < MENU_ITEMS_COUNT; i++)
-		{
-			MenuItem currentItem = menuOffset + i;
-			LCD_SetCursor(lcd_address, 0, i);
+	// Only the cells that changed go out over I2C
+	LCD_Flush(lcd_address);
+}
 
-			// Show cursor for selected item
-			if (currentItem == selectedMenuItem)
+// Handle encoder input and update menu state. detents is the raw move,
+// step the accelerated one used for values
+void handleEncoder(uint8_t lcd_address, int16_t detents, int16_t step)
+{
+	switch (currentState)
+	{
+	case DISPLAYING_DATA:
+		menu_open(&mainMenu);
+		currentState = IN_MENU;
+		displayDirty = true;
+		break;
+
+	case IN_MENU:
+		displayDirty |= menu_scroll(detents);
+		break;
+
+	case EDITING_VALUE:
+		// Only the value field changes, the rest of the frame stays as
+		// the last full draw left it
+		if (menu_edit(step))
+		{
+			if (menu_draw_value())
 			{
-				LCD_WriteString(lcd_address, ">");
+				valueDirty = true;
 			}
 			else
 			{
-				LCD_WriteString(lcd_address, " ");
+				displayDirty = true;
 			}
-
-			LCD_WriteString(lcd_address, " ");
-			LCD_WriteString(lcd_address, getMenuItemText(currentItem));
 		}
 		break;
+	}
+}
 
-	case EDITING_VALUE:
-		LCD_SetCursor(lcd_address, 0, 0);
-		switch (selectedMenuItem)
+// Turns the TIM2 count into INPUT_ENCODER events
+void encoderPoll(void)
+{
+	// The 16 bit difference is right across the counter wrap, the knob
+	// cannot turn 32768 pulses in one poll
+	uint16_t count = TIM2->CNT;
+	encoderPulses += (int16_t)(count - encoderCount);
+	encoderCount = count;
+
+	// Whole detents only, a half turned detent stays for the next poll
+	int16_t detents = encoderPulses / PULSES_PER_DETENT;
+	if (detents == 0)
+	{
+		return;
+	}
+	encoderPulses -= detents * PULSES_PER_DETENT;
+
+	// Speed from the time since the last detent, the compare against
+	// ms per detent is done by adding up ms once per detent
+	uint32_t elapsed = elapsed_ms(encoderMoveTime);
+	uint16_t moved = detents < 0 ? -detents : detents; // as wide as detents
+	uint8_t shift = 0;
+	encoderMoveTime = millis();
+
+	for (uint8_t i = 0; i < sizeof(encoderAccel) / sizeof(encoderAccel[0]); i++)
+	{
+		uint32_t window = 0;
+		for (uint16_t n = 0; n < moved && window <= elapsed; n++)
 		{
-		case SET_TEMP1:
-			LCD_WriteString(lcd_address, "Set Temp 1:");
-			LCD_SetCursor(lcd_address, 0, 1);
-			LCD_WriteString(lcd_address, "> ");
-			sprintf(buf, "%d", temperature1);
-			LCD_WriteString(lcd_address, buf);
-			LCD_WriteChar(lcd_address, 223); // Degree symbol
+			window += encoderAccel[i].ms;
+		}
+		if (elapsed < window)
+		{
+			shift = encoderAccel[i].shift;
 			break;
+		}
+	}
 
-		case SET_TEMP2:
-			LCD_WriteString(lcd_address, "Set Temp 2:");
-			LCD_SetCursor(lcd_address, 0, 1);
-			LCD_WriteString(lcd_address, "> ");
-			sprintf(buf, "%d", temperature2);
-			LCD_WriteString(lcd_address, buf);
-			LCD_WriteChar(lcd_address, 223);
-			break;
+	input_put(&inputQueue, INPUT_ENCODER, shift, detents, encoderMoveTime);
+}
 
-		case SET_UNITS:
-			LCD_WriteString(lcd_address, "Set Units:");
-			LCD_SetCursor(lcd_address, 0, 1);
-			LCD_WriteString(lcd_address, "> ");
-			sprintf(buf, "%s", units);
-			LCD_WriteString(lcd_address, units);
-			break;
+// Save settings and go back to the data screen
+void exitMenu(void)
+{
+	if (menu_take_changes())
+	{
+		SaveSettings(&settings);
+	}
+	applySettings();
+	currentState = DISPLAYING_DATA;
+}
 
-		case EXIT:
-			currentState = DISPLAYING_DATA;
+void buttonClick(void)
+{
+	switch (currentState)
+	{
+	case IN_MENU:
+		switch (menu_select())
+		{
+		case MENU_EDIT:
+			currentState = EDITING_VALUE;
+			break;
+		case MENU_CLOSE:
+			exitMenu();
+			break;
+		default:
 			break;
-		case MENU_ITEMS_COUNT:
-			break; // Should never happen
 		}
 		break;
 
+	case EDITING_VALUE:
+		currentState = IN_MENU;
+		break;
+
 	case DISPLAYING_DATA:
-		// First temperature setting
-		LCD_SetCursor(lcd_address, 0, 0);
-		sprintf(temp_buf, "T1:%d", temperature1);
-		LCD_WriteString(lcd_address, temp_buf);
-		LCD_WriteChar(lcd_address, 223); // Degree symbol
-
-		// Display fan1 state
-		LCD_SetCursor(lcd_address, 8, 0);
-		if (fan1_state)
+		menu_open(&mainMenu);
+		currentState = IN_MENU;
+		break;
+	}
+}
+
+void handleButton(button_event_t event)
+{
+	switch (event)
+	{
+	case BUTTON_CLICK:
+	case BUTTON_DOUBLE_CLICK: // quick second clicks are still clicks
+		buttonClick();
+		displayDirty = true;
+		break;
+
+	case BUTTON_LONG_PRESS:
+		// Leave the menu from anywhere
+		if (currentState != DISPLAYING_DATA)
 		{
-			LCD_WriteString(lcd_address, "F1:ON");
+			exitMenu();
+			displayDirty = true;
 		}
-		else
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Produces the encoder and button events, then drains everything queued
+// in one go, so a burst of input costs a single redraw
+void inputTask(void)
+{
+	static bool waking = false; // button press that turned the backlight on
+	InputEvent event;
+
+	encoderPoll();
+	button_update(&inputQueue);
+
+	while (input_get(&inputQueue, &event))
+	{
+		lastInteractionTime = millis();
+
+		// With the backlight off any input only wakes the screen, and
+		// the rest of a waking button press is ignored
+		if (!backlight_state)
 		{
-			LCD_WriteString(lcd_address, "F1:OFF");
+			backlight_state = true;
+			LCD_SetBacklight(lcd_address, 1);
+			waking = event.type == INPUT_BUTTON;
+			continue;
 		}
-		// Display fan2 state
-		LCD_SetCursor(lcd_address, 8, 1);
-		if (fan2_state)
+		if (waking)
 		{
-			LCD_WriteString(lcd_address, "F2:ON");
+			waking = !(event.type == INPUT_BUTTON && event.code == BUTTON_RELEASE);
+			continue;
 		}
-		else
+
+		if (event.type == INPUT_ENCODER)
 		{
-			LCD_WriteString(lcd_address, "F2:OFF");
+			handleEncoder(lcd_address, event.value, event.value * (1 << event.code));
 		}
-		// Second temperature setting
-		LCD_SetCursor(lcd_address, 0, 1);
-		sprintf(temp_buf, "T2:%d", temperature2);
-		LCD_WriteString(lcd_address, temp_buf);
-		LCD_WriteChar(lcd_address, 223);
+		else if (event.type == INPUT_BUTTON)
+		{
+			handleButton(event.code);
+		}
+	}
 
-		// Display sensor readings
-		LCD_SetCursor(lcd_address, 0, 3);
-		sprintf(temp_buf, "Reading:%d%s    ", sensor1Value, units);
-		LCD_WriteString(lcd_address, temp_buf);
-		break;
+	// Send an edited value straight away, a handful of bytes for the
+	// changed digits, instead of waiting for the display task. A full
+	// redraw pending anyway covers it
+	if (valueDirty)
+	{
+		valueDirty = false;
+		if (!displayDirty)
+		{
+			LCD_Flush(lcd_address);
+		}
 	}
 }
 
-// Handle encoder input and update menu state
-void handleEncoder(uint8_t lcd_address, int32_t position)
+void sensorTask(void)
 {
-	lastInteractionTime = get_Time();
-	static int32_t lastPosition = 0;
-	if (position != lastPosition)
+	sensors_scan();
+}
+
+// Fail safe: without a trustworthy control sensor every fan runs flat
+// out. A sensor that has not been read yet does not count
+bool failsafeActive(void)
+{
+	return sensors[0].fault && sensors[0].fault != SENSOR_FAULT_NO_DATA;
+}
+
+// Runs the relay tune on both fans, stores the gains when it finishes
+void tuneFans(void)
+{
+	// fanTask takes the fans to the fail safe from the next tick
+	if (failsafeActive())
 	{
+		autotune_abort(&fanTune);
+		return;
+	}
 
-		int8_t delta = (position > lastPosition) ? 1 : -1;
-		lastPosition = position;
+	uint16_t duty = autotune_update(&fanTune, sensors[0].temp_c4, millis());
+	for (uint8_t i = 0; i < FAN_COUNT; i++)
+	{
+		fan_set_duty(i, duty);
+		pid_reset(&fanPid[i]);
+		fanStages[i].written = false; // relay fans get their state back after
+	}
 
-		if (currentState == DISPLAYING_DATA)
-		{
-			currentState = IN_MENU;
-			selectedMenuItem = SET_TEMP1;
-			menuOffset = 0;
-			updateMenu(lcd_address);
-		}
-		else if (currentState == IN_MENU)
-		{
-			int8_t newItem = selectedMenuItem + delta;
-			if (newItem >= 0 && newItem < MENU_ITEMS_COUNT)
-			{
-				selectedMenuItem = newItem;
-				updateMenu(lcd_address);
-			}
-		}
-		else if (currentState == EDITING_VALUE)
+	if (autotune_gains(&fanTune, &fanPidConfig))
+	{
+		settings.kp = fanPidConfig.kp;
+		settings.ki = fanPidConfig.ki;
+		settings.kd = fanPidConfig.kd;
+		SaveSettings(&settings);
+	}
+}
+
+// Adds new sensor 1 readings to the trend and projects it
+// settings.lookahead seconds ahead. false while there is no projection
+bool projectTemp(temp_q2_t *projected)
+{
+	Sensor *sensor = &sensors[0];
+
+	if (sensor->fault)
+	{
+		trend_reset(&fanTrend);
+		return false;
+	}
+	if (sensor->timestamp != trendStamp)
+	{
+		trendStamp = sensor->timestamp;
+		trend_add(&fanTrend, trendStamp, sensor->temp_c4);
+	}
+	return settings.lookahead && trend_project(&fanTrend, settings.lookahead * 1000UL, projected);
+}
+
+// Tracks how far sensor 1 goes past setpoint 1 before coming back under
+void trackOvershoot(void)
+{
+	if (sensors[0].fault)
+	{
+		return;
+	}
+
+	temp_q2_t over = sensors[0].temp_c4 - setpointC4(settings.temperature1);
+	if (over > overshootPeak)
+	{
+		overshootPeak = over;
+	}
+	else if (over <= 0 && overshootPeak > 0)
+	{
+		fanOvershoot = overshootPeak;
+		overshootPeak = 0;
+	}
+}
+
+// A fan that has been seen spinning is stalled when it is driven and
+// reads 0 RPM after its spin up time
+void checkStalls(void)
+{
+	tach_update();
+
+	for (uint8_t i = 0; i < FAN_COUNT; i++)
+	{
+		if (fan_duty(i) == 0)
 		{
-			switch (selectedMenuItem)
-			{
-			case SET_TEMP1:
-				if (delta > 0 && temperature1 < 255)
-					temperature1++;
-				else if (delta < 0 && temperature1 > 0)
-					temperature1--;
-				break;
-
-			case SET_TEMP2:
-				if (delta > 0 && temperature2 < 255)
-					temperature2++;
-				else if (delta < 0 && temperature2 > 0)
-					temperature2--;
-				break;
-			case SET_UNITS:
-				if (delta > 0)
-				{
-					fahrenheit = !fahrenheit;
-					if (fahrenheit)
-					{
-						units[0] = 'F';
-					}
-					else
-					{
-						units[0] = 'C';
-					}
-				}
-				break;
-			}
-			updateMenu(lcd_address);
+			fanOffTime[i] = millis();
+			fanStalled[i] = false;
+			continue;
 		}
+		fanStalled[i] = tach_present(i) && tach_rpm(i) == 0 && elapsed_ms(fanOffTime[i]) > FAN_SPINUP_MS;
 	}
 }
 
-uint32_t get_Time(void)
+void fanSwitch(uint8_t fan, bool on)
 {
-	uint32_t currTick = SysTick->CNT;
-	return (currTick * TICK_NS) / 1e6;
+	fan_set_duty(fan, on ? FAN_DUTY_MAX : 0);
+}
+
+// Staging input: the reading, or the look ahead projection when that is
+// higher, so fans start early but do not stop early
+bool stageTemp(uint8_t sensor, temp_q2_t *temp)
+{
+	if (sensors[sensor].fault)
+	{
+		return false;
+	}
+	*temp = sensors[sensor].temp_c4;
+	if (sensor == 0 && fanAhead && fanProjected > *temp)
+	{
+		*temp = fanProjected;
+	}
+	return true;
 }
 
-uint8_t checkButton(void)
+void fanTask(void)
 {
-	static uint32_t lastDebounceTime = 0;
-	static uint8_t lastButtonState = 1;
-	static uint8_t buttonState = 1;
+	fanAhead = projectTemp(&fanProjected);
 
-	uint8_t reading = (GPIOC->INDR & BUTTON_PIN) ? 1 : 0;
-	uint32_t currentTime = get_Time();
+	trackOvershoot();
+	checkStalls();
 
-	if (reading != lastButtonState)
+	if (fanTune.state == AUTOTUNE_RUNNING)
 	{
-		lastDebounceTime = currentTime;
+		tuneFans();
+		if (backlight_state)
+		{
+			displayDirty = true;
+		}
+		return;
 	}
 
-	lastButtonState = reading;
+	bool failsafe = failsafeActive();
 
-	if ((currentTime - lastDebounceTime) > DEBOUNCE_TIME)
+	for (uint8_t i = 0; i < FAN_COUNT; i++)
 	{
-		if (reading != buttonState)
+		int setpoint = i == 0 ? settings.temperature1 : settings.temperature2;
+
+		// Relay mode fans are left to their stage
+		fanStages[i].enabled = !failsafe && !(settings.fan_pwm & SETTINGS_FAN_PWM(i));
+		fanStages[i].on = setpointC4(setpoint);
+		fanStages[i].off = fanStages[i].on - FAN_HYSTERESIS;
+
+		if (fanStages[i].enabled)
 		{
-			buttonState = reading;
-
-			if (buttonState == 0)
-			{ // Button pressed
-				lastInteractionTime = currentTime;
-
-				// If backlight is off, turn it on and consume press
-				if (!backlight_state)
-				{
-					backlight_state = true;
-					LCD_SetBacklight(0x27, 1);
-					return 0;
-				}
-				return 1; // Return 1 to process menu action
-			}
+			pid_reset(&fanPid[i]);
+		}
+		else if (failsafe || fanStalled[i])
+		{
+			// Kick a stalled fan at full duty until it turns again
+			pid_reset(&fanPid[i]);
+			fan_set_duty(i, FAN_DUTY_MAX);
+		}
+		else if (!sensors[0].fault)
+		{
+			// The loop runs in Celsius so the gains do not depend on the units
+			fan_set_duty(i, pid_update(&fanPid[i], &fanPidConfig, setpointC4(setpoint), sensors[0].temp_c4));
+		}
+	}
+	staging_update(fanStages, FAN_STAGES, stageTemp, millis());
+
+	// Fan states go out on the expander too, for relay boards on the 595s.
+	// One shift and latch per tick, and only when something changed
+	for (uint8_t i = 0; i < FAN_COUNT; i++)
+	{
+		expander_set(i, fan_duty(i) != 0);
+	}
+	expander_flush();
+
+	// Refresh the readings on screen
+	if (backlight_state)
+	{
+		displayDirty = true;
+	}
+}
+
+void displayTask(void)
+{
+	// Recover the bus if a queued LCD transfer got stuck
+	i2c_poll();
+
+	// Check for screen timeout
+	if (backlight_state && elapsed_ms(lastInteractionTime) > SCREEN_TIMOUT)
+	{
+		if (currentState == DISPLAYING_DATA)
+		{
+			backlight_state = false;
+			LCD_SetBacklight(lcd_address, 0);
+		}
+		else
+		{
+			lastInteractionTime = millis();
 		}
 	}
-	return 0;
+
+	// Every streamed byte carries the backlight bit, so a redraw would light
+	// a timed out screen again. A change stays pending until it wakes
+	if (displayDirty && backlight_state)
+	{
+		displayDirty = false;
+		updateMenu(lcd_address);
+	}
 }
 
+// Table order is run order when several tasks are released on the same tick
+SchedTask tasks[] = {
+	{inputTask, INPUT_PERIOD, INPUT_PERIOD},
+	{sensorTask, SENSOR_SLOT_MS, 10},
+	{fanTask, FAN_PERIOD, 10},
+	{displayTask, DISPLAY_PERIOD, 50},
+};
+
 int main()
 {
 	SystemInit();
+	systime_init();
 	backlight_state = true;
-	lastInteractionTime = get_Time();
-	setup_temp_sensor();
+	lastInteractionTime = millis();
+	sensors_init();
+	expander_init();
 	// Enable GPIO for LCD and button
 	RCC->APB2PCENR |= RCC_APB2Periph_GPIOD | RCC_APB2Periph_GPIOC;
 
@@ -565,135 +917,26 @@ int main()
 	LCD_Clear(lcd_address);
 	LCD_SetBacklight(lcd_address, 1);
 
-	// Configure PC3 as input with pull-up
-	GPIOC->CFGLR &= ~(0xF << (4 * 3));			   // Clear PC3 configuration
-	GPIOC->CFGLR |= (GPIO_CNF_IN_PUPD << (4 * 3)); // Set as input with pull-up/down
-	GPIOC->BSHR = GPIO_Pin_3;					   // Set PC3 high to enable pull-up
-	// Load settings from EEPROM
-	Settings settings;
-	LoadSettings(&settings);
+	// Encoder button on EXTI
+	button_init();
 
-	// Configure output pins
-	GPIOD->CFGLR &= ~(0xF << (4 * FAN_1));			  // Clear pin1 configuration
-	GPIOD->CFGLR |= (GPIO_CNF_OUT_PP << (4 * FAN_1)); // Set as output push-pull
-	GPIOD->OUTDR |= 0 << FAN_1;						  // Set pin1 low
-	GPIOD->CFGLR &= ~(0xF << (4 * FAN_2));			  // Clear pin2 configuration
-	GPIOD->CFGLR |= (GPIO_CNF_OUT_PP << (4 * FAN_2)); // Set as output push-pull
-	GPIOD->OUTDR |= 0 << FAN_2;						  // Set pin2 low
+	// Load settings from flash
+	LoadSettings(&settings);
 
-	// Update global variables with loaded settings
-	temperature1 = settings.temperature1;
-	temperature2 = settings.temperature2;
+	// Fan outputs, both off
+	fan_init();
+	applySettings();
+	tach_init();
+	staging_init(fanStages, FAN_STAGES, millis());
 
-	// Initial display update
-	updateMenu(lcd_address);
+	sched_init(tasks, sizeof(tasks) / sizeof(tasks[0]));
 
 	while (1)
 	{
-		// Handle encoder
-		uint16_t current_count = TIM2->CNT;
-		int32_t position = (int32_t)current_count - initial_count;
-		int current_pos = position / PULSES_PER_DETENT;
-
-		if (oldPos != current_pos)
+		// Sleep until the next tick if nothing was due
+		if (sched_run() == 0)
 		{
-			lastInteractionTime = get_Time();
-			handleEncoder(lcd_address, current_pos);
-			oldPos = current_pos;
+			__WFI();
 		}
-
-		// Handle button
-		if (checkButton())
-		{
-			lastInteractionTime = get_Time();
-			switch (currentState)
-			{
-			case IN_MENU:
-				if (selectedMenuItem == EXIT)
-				{
-					// Save settings before exiting menu
-					settings.temperature1 = temperature1;
-					settings.temperature2 = temperature2;
-					SaveSettings(&settings);
-					currentState = DISPLAYING_DATA;
-				}
-				else
-				{
-					currentState = EDITING_VALUE;
-				}
-				break;
-
-			case EDITING_VALUE:
-				currentState = IN_MENU;
-				break;
-
-			case DISPLAYING_DATA:
-				currentState = IN_MENU;
-				selectedMenuItem = SET_TEMP1;
-				menuOffset = 0;
-				break;
-			}
-			updateMenu(lcd_address);
-		}
-
-		// Check sensors every second, update fans
-
-		uint32_t current_time = get_Time();
-		if (current_time - last_sensor_check > 1000)
-		{
-			readSensors();
-			if (sensor1Value > temperature1)
-			{
-				if(fan1_state == 0)
-				{
-					fan1_state = 1;
-					GPIOD->OUTDR |= 1 << FAN_1;
-				}
-			}
-			else
-			{
-				if(fan1_state == 1)
-				{
-					fan1_state = 0;
-					GPIOD->OUTDR &= ~(1 << FAN_1);
-				}
-			}
-			if (sensor1Value > temperature2)
-			{
-				fan2_state = 1;
-				GPIOD->OUTDR |= 1 << FAN_2;
-			}
-			else
-			{
-				fan2_state = 0;
-				GPIOD->OUTDR &= ~(1 << FAN_2);
-			}
-
-			// Check for screen timeout
-			counter++;
-			if (counter > 10)
-			{
-				if (current_time - lastInteractionTime > 10000)
-				{
-					backlight_state = false;
-					counter = 0;
-					if (currentState == DISPLAYING_DATA)
-					{
-						LCD_SetBacklight(0x27, 0);
-					}
-					else
-					{
-						lastInteractionTime = get_Time();
-						backlight_state = true;
-					}
-				}
-			}
-			last_sensor_check = current_time;
-			if (backlight_state)
-			{
-				updateMenu(lcd_address);
-			}
-		}
-		Delay_Ms(10);
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,159 @@
+#include "max6675.h"
+#include <stddef.h>
+
+static volatile bool busy = false;
+
+void max6675_init_cs(GPIO_TypeDef *cs_port, uint8_t cs_pin)
+{
+	cs_port->CFGLR &= ~(0xf << (4 * cs_pin));
+	cs_port->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP) << (4 * cs_pin);
+	cs_port->BSHR = 1 << cs_pin; // CS starts high
+}
+
+bool max6675_busy(void)
+{
+	return busy;
+}
+
+#ifdef MAX6675_USE_SPI_DMA
+
+static volatile uint16_t rx_frame;
+static GPIO_TypeDef *active_cs_port;
+static uint8_t active_cs_pin;
+static max6675_callback_t active_callback;
+
+void max6675_init(void)
+{
+	RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_GPIOD | RCC_APB2Periph_SPI1;
+	RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+
+	// Configure SCK (PC5) as alternate function push-pull
+	MAX6675_SCK_PORT->CFGLR &= ~(0xf << (4 * MAX6675_SCK_PIN));
+	MAX6675_SCK_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP_AF) << (4 * MAX6675_SCK_PIN);
+
+	// Configure MISO (PC7) as input floating
+	MAX6675_MISO_PORT->CFGLR &= ~(0xf << (4 * MAX6675_MISO_PIN));
+	MAX6675_MISO_PORT->CFGLR |= GPIO_CNF_IN_FLOATING << (4 * MAX6675_MISO_PIN);
+
+	// Master, mode 0, 16 bit frames, 48MHz / 16 = 3MHz (MAX6675 max is 4.3MHz).
+	// Software NSS so PC1 stays free for I2C SDA.
+	SPI1->CTLR1 = SPI_CTLR1_MSTR | SPI_CTLR1_SSM | SPI_CTLR1_SSI |
+				  SPI_DataSize_16b | SPI_BaudRatePrescaler_16;
+	SPI1->CTLR2 = SPI_CTLR2_RXDMAEN;
+	SPI1->CTLR1 |= SPI_CTLR1_SPE;
+
+	// DMA1 channel 2 is SPI1 RX, one halfword per read
+	DMA1_Channel2->CFGR = 0;
+	DMA1_Channel2->PADDR = (uint32_t)&SPI1->DATAR;
+	DMA1_Channel2->MADDR = (uint32_t)&rx_frame;
+	DMA1_Channel2->CFGR = DMA_CFGR1_PSIZE_0 | DMA_CFGR1_MSIZE_0 | DMA_CFGR1_TCIE | DMA_CFGR1_PL_1;
+	NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+}
+
+bool max6675_start(GPIO_TypeDef *cs_port, uint8_t cs_pin, max6675_callback_t callback)
+{
+	if (busy)
+	{
+		return false;
+	}
+	busy = true;
+	active_cs_port = cs_port;
+	active_cs_pin = cs_pin;
+	active_callback = callback;
+
+	// Drain a stale frame so the DMA only sees this one
+	(void)SPI1->DATAR;
+
+	DMA1_Channel2->CNTR = 1;
+	DMA1_Channel2->CFGR |= DMA_CFGR1_EN;
+
+	cs_port->BCR = 1 << cs_pin;
+	SPI1->DATAR = 0; // dummy write clocks the 16 bits in
+	return true;
+}
+
+void DMA1_Channel2_IRQHandler(void) __attribute__((interrupt));
+void DMA1_Channel2_IRQHandler(void)
+{
+	DMA1->INTFCR = DMA1_IT_GL2;
+	DMA1_Channel2->CFGR &= ~DMA_CFGR1_EN;
+
+	// Raising CS starts the next conversion
+	active_cs_port->BSHR = 1 << active_cs_pin;
+	busy = false;
+
+	if (active_callback != NULL)
+	{
+		active_callback(rx_frame);
+	}
+}
+
+#else
+
+void max6675_init(void)
+{
+	RCC->APB2PCENR |= RCC_APB2Periph_GPIOC | RCC_APB2Periph_GPIOD;
+
+	// Configure SCK (PC5) as output
+	MAX6675_SCK_PORT->CFGLR &= ~(0xf << (4 * MAX6675_SCK_PIN));
+	MAX6675_SCK_PORT->CFGLR |= (GPIO_Speed_10MHz | GPIO_CNF_OUT_PP) << (4 * MAX6675_SCK_PIN);
+
+	// Configure MISO (PC7) as input floating
+	MAX6675_MISO_PORT->CFGLR &= ~(0xf << (4 * MAX6675_MISO_PIN));
+	MAX6675_MISO_PORT->CFGLR |= GPIO_CNF_IN_FLOATING << (4 * MAX6675_MISO_PIN);
+
+	MAX6675_SCK_PORT->BCR = 1 << MAX6675_SCK_PIN; // SCK starts low
+
+	Delay_Ms(1); // Short delay after setup
+}
+
+// BITTY BITTY BANG BANG !!!
+static uint16_t read_single_sensor(GPIO_TypeDef *cs_port, uint8_t cs_pin)
+{
+	uint16_t raw_value = 0;
+
+	cs_port->BSHR = 1 << cs_pin;
+	Delay_Us(50);
+
+	cs_port->BCR = 1 << cs_pin;
+	Delay_Us(50);
+
+	for (int i = 15; i >= 0; i--)
+	{
+		MAX6675_SCK_PORT->BCR = 1 << MAX6675_SCK_PIN;
+		Delay_Us(10);
+
+		if (MAX6675_MISO_PORT->INDR & (1 << MAX6675_MISO_PIN))
+		{
+			raw_value |= (1 << i);
+		}
+
+		MAX6675_SCK_PORT->BSHR = 1 << MAX6675_SCK_PIN;
+		Delay_Us(10);
+	}
+
+	cs_port->BSHR = 1 << cs_pin;
+	Delay_Us(50);
+
+	return raw_value;
+}
+
+bool max6675_start(GPIO_TypeDef *cs_port, uint8_t cs_pin, max6675_callback_t callback)
+{
+	if (busy)
+	{
+		return false;
+	}
+	busy = true;
+
+	uint16_t raw = read_single_sensor(cs_port, cs_pin);
+	busy = false;
+
+	if (callback != NULL)
+	{
+		callback(raw);
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MAX6675_H
+#define MAX6675_H
+
+#include "ch32v003fun.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * MAX6675 thermocouple reader on the shared SCK/MISO lines.
+ * SCK -> PC5, MISO -> PC7, one CS pin per chip.
+ *
+ * With MAX6675_USE_SPI_DMA the 16 bit frame is clocked by SPI1 and received
+ * by DMA1 channel 2, max6675_start() returns straight away and the callback
+ * runs from the DMA interrupt. Comment it out to fall back to bit-banging,
+ * where max6675_start() blocks for the read and calls the callback itself.
+ */
+#define MAX6675_USE_SPI_DMA
+
+#define MAX6675_SCK_PORT GPIOC
+#define MAX6675_SCK_PIN 5
+#define MAX6675_MISO_PORT GPIOC
+#define MAX6675_MISO_PIN 7
+
+// Open thermocouple flag in the raw frame
+#define MAX6675_OPEN 0x4
+
+typedef void (*max6675_callback_t)(uint16_t raw);
+
+/**
+ * @brief Sets up the SCK/MISO pins, and SPI1 + DMA when enabled.
+ */
+void max6675_init(void);
+
+/**
+ * @brief Configures a chip select pin as output, idle high.
+ * @param cs_port GPIO port of the CS pin.
+ * @param cs_pin Pin number of the CS pin.
+ */
+void max6675_init_cs(GPIO_TypeDef *cs_port, uint8_t cs_pin);
+
+/**
+ * @brief Starts reading one frame from the chip on the given CS pin.
+ * @param cs_port GPIO port of the CS pin.
+ * @param cs_pin Pin number of the CS pin.
+ * @param callback Called with the raw 16 bit frame when the read is done.
+ * @return false if a read is already in flight.
+ */
+bool max6675_start(GPIO_TypeDef *cs_port, uint8_t cs_pin, max6675_callback_t callback);
+
+/**
+ * @brief Returns true while a read is in flight.
+ */
+bool max6675_busy(void);
+
+#endif
@@ -0,0 +1,236 @@
+#include "menu.h"
+#include "../lib/lcd_i2c.h"
+#include <stddef.h>
+
+typedef struct
+{
+	const MenuPage *page;
+	uint8_t selected;
+	uint8_t offset; // first row on screen
+} MenuLevel;
+
+static MenuLevel levels[MENU_DEPTH];
+static uint8_t depth; // index of the current level
+static bool changes;
+
+static MenuLevel *menu_level(void)
+{
+	return &levels[depth];
+}
+
+static const MenuEntry *menu_entry(void)
+{
+	MenuLevel *level = menu_level();
+	return &level->page->entries[level->selected];
+}
+
+void menu_open(const MenuPage *root)
+{
+	depth = 0;
+	levels[0].page = root;
+	levels[0].selected = 0;
+	levels[0].offset = 0;
+}
+
+bool menu_scroll(int16_t detents)
+{
+	MenuLevel *level = menu_level();
+	int16_t selected = level->selected + detents;
+
+	if (selected < 0)
+	{
+		selected = 0;
+	}
+	else if (selected >= level->page->count)
+	{
+		selected = level->page->count - 1;
+	}
+	if (selected == level->selected)
+	{
+		return false;
+	}
+	level->selected = selected;
+
+	// Keep the selection on screen
+	if (level->selected < level->offset)
+	{
+		level->offset = level->selected;
+	}
+	else if (level->selected >= level->offset + MENU_LINES)
+	{
+		level->offset = level->selected - MENU_LINES + 1;
+	}
+	return true;
+}
+
+menu_result_t menu_select(void)
+{
+	const MenuEntry *entry = menu_entry();
+
+	switch (entry->type)
+	{
+	case MENU_SUBMENU:
+		if (depth + 1 < MENU_DEPTH)
+		{
+			depth++;
+			levels[depth].page = entry->page;
+			levels[depth].selected = 0;
+			levels[depth].offset = 0;
+		}
+		return MENU_STAY;
+
+	case MENU_BACK:
+		if (depth == 0)
+		{
+			return MENU_CLOSE;
+		}
+		depth--;
+		return MENU_STAY;
+
+	case MENU_EXIT:
+		return MENU_CLOSE;
+
+	default:
+		if (entry->flags & MENU_PERSIST)
+		{
+			changes = true;
+		}
+		if (entry->enter != NULL)
+		{
+			entry->enter();
+		}
+		return MENU_EDIT;
+	}
+}
+
+bool menu_edit(int16_t step)
+{
+	const MenuEntry *entry = menu_entry();
+
+	switch (entry->type)
+	{
+	case MENU_NUMBER:
+	{
+		int16_t min = entry->min;
+		int16_t max = entry->max;
+		int16_t value = *entry->value + step * entry->step;
+
+		if (entry->flags & MENU_BOUND_MIN)
+		{
+			min = *entry->bound;
+		}
+		if (entry->flags & MENU_BOUND_MAX)
+		{
+			max = *entry->bound;
+		}
+		if (value < min)
+		{
+			value = min;
+		}
+		else if (value > max)
+		{
+			value = max;
+		}
+		if (value == *entry->value)
+		{
+			return false;
+		}
+		*entry->value = value;
+		break;
+	}
+
+	case MENU_FLAG:
+		*entry->value ^= entry->max;
+		break;
+
+	case MENU_SCREEN:
+		break;
+
+	default:
+		return false;
+	}
+
+	if (entry->flags & MENU_PERSIST)
+	{
+		changes = true;
+	}
+	if (entry->changed != NULL)
+	{
+		entry->changed();
+	}
+	return true;
+}
+
+void menu_draw_list(void)
+{
+	MenuLevel *level = menu_level();
+
+	for (uint8_t i = 0; i < MENU_LINES && level->offset + i < level->page->count; i++)
+	{
+		uint8_t row = level->offset + i;
+
+		LCD_FrameSetCursor(0, i);
+		LCD_FrameWriteString(row == level->selected ? "> " : "  ");
+		LCD_FrameWriteString(level->page->entries[row].label);
+	}
+}
+
+static void menu_draw_field(const MenuEntry *entry)
+{
+	char buf[LCD_COLS + 1];
+	uint8_t value = *entry->value;
+
+	if (entry->type == MENU_FLAG)
+	{
+		value = (value & entry->max) != 0;
+	}
+
+	char *end = entry->format(buf, value);
+	*end = '\0';
+
+	// Pad on the left so stale cells of a longer value get blanked
+	LCD_FrameSetCursor(MENU_VALUE_COL, MENU_VALUE_ROW);
+	for (uint8_t len = end - buf; len < MENU_VALUE_WIDTH; len++)
+	{
+		LCD_FrameWriteChar(' ');
+	}
+	LCD_FrameWriteString(buf);
+}
+
+void menu_draw_edit(void)
+{
+	const MenuEntry *entry = menu_entry();
+
+	if (entry->type != MENU_SCREEN)
+	{
+		LCD_FrameSetCursor(0, 0);
+		LCD_FrameWriteString(entry->label);
+		LCD_FrameWriteChar(':');
+		LCD_FrameSetCursor(0, MENU_VALUE_ROW);
+		LCD_FrameWriteString("> ");
+		menu_draw_field(entry);
+	}
+	if (entry->draw != NULL)
+	{
+		entry->draw();
+	}
+}
+
+bool menu_draw_value(void)
+{
+	const MenuEntry *entry = menu_entry();
+
+	if (entry->type == MENU_SCREEN)
+	{
+		return false;
+	}
+	menu_draw_field(entry);
+	return true;
+}
+
+bool menu_take_changes(void)
+{
+	bool taken = changes;
+	changes = false;
+	return taken;
+}
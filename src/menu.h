@@ -0,0 +1,124 @@
+#ifndef MENU_H
+#define MENU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Table driven menu. Every page is a const table of MenuEntry in flash,
+ * one row per item, and the same code lists, edits and draws all of them.
+ * Adding a setting is adding a row. Pages nest through MENU_SUBMENU rows
+ * up to MENU_DEPTH deep, MENU_BACK goes up a level.
+ *
+ * Values are uint8_t. A MENU_NUMBER row moves its value by step per
+ * detent within min and max. When bound is set it replaces max
+ * (MENU_BOUND_MAX) or min (MENU_BOUND_MIN), for limits that depend on
+ * another setting. A MENU_FLAG row toggles the max bits of its value on
+ * every move. MENU_SCREEN rows have no value, draw fills the whole screen.
+ */
+#define MENU_DEPTH 3
+#define MENU_LINES 4 // rows of the list on screen
+
+// Value field of the edit screen. Values are right aligned in a fixed
+// width, so an edit only ever touches these cells
+#define MENU_VALUE_COL 2
+#define MENU_VALUE_ROW 1
+#define MENU_VALUE_WIDTH 5
+
+typedef enum
+{
+	MENU_NUMBER,
+	MENU_FLAG,
+	MENU_SCREEN,
+	MENU_SUBMENU,
+	MENU_BACK,
+	MENU_EXIT,
+} menu_type_t;
+
+// Row flags
+#define MENU_PERSIST 0x01	// saved to flash when the menu closes
+#define MENU_BOUND_MIN 0x02 // bound replaces min
+#define MENU_BOUND_MAX 0x04 // bound replaces max
+
+typedef struct MenuPage MenuPage;
+
+typedef struct
+{
+	const char *label;
+	uint8_t type;
+	uint8_t flags;
+	uint8_t min;
+	uint8_t max; // bit mask for MENU_FLAG
+	uint8_t step;
+	union
+	{
+		uint8_t *value;		  // MENU_NUMBER, MENU_FLAG
+		const MenuPage *page; // MENU_SUBMENU
+	};
+	const uint8_t *bound;
+	// Writes the value for display, returns the end of the text. MENU_FLAG
+	// rows get 1 or 0 for the bits
+	char *(*format)(char *buf, uint8_t value);
+	void (*draw)(void);	   // extra rows under the value, or the whole MENU_SCREEN
+	void (*enter)(void);   // the row was opened for editing
+	void (*changed)(void); // the value changed, or a MENU_SCREEN was turned
+} MenuEntry;
+
+struct MenuPage
+{
+	const MenuEntry *entries;
+	uint8_t count;
+};
+
+typedef enum
+{
+	MENU_STAY, // still in the list
+	MENU_EDIT, // a row was opened for editing
+	MENU_CLOSE,
+} menu_result_t;
+
+/**
+ * @brief Opens the menu at the first row of the root page.
+ */
+void menu_open(const MenuPage *root);
+
+/**
+ * @brief Moves the selection by detents, clamped to the page.
+ * @return true if the selection moved.
+ */
+bool menu_scroll(int16_t detents);
+
+/**
+ * @brief Activates the selected row.
+ */
+menu_result_t menu_select(void);
+
+/**
+ * @brief Edits the open row by step, the accelerated detent count.
+ * @return true if anything changed.
+ */
+bool menu_edit(int16_t step);
+
+/**
+ * @brief Draws the list of the current page into the LCD frame.
+ */
+void menu_draw_list(void);
+
+/**
+ * @brief Draws the open row into the LCD frame.
+ */
+void menu_draw_edit(void);
+
+/**
+ * @brief Redraws only the value field of the open row, over the frame
+ * menu_draw_edit() left.
+ * @return false for MENU_SCREEN rows, which need the whole screen.
+ */
+bool menu_draw_value(void);
+
+/**
+ * @brief true once after a MENU_PERSIST row changed or was entered.
+ */
+bool menu_take_changes(void);
+
+#endif
@@ -0,0 +1,136 @@
+#include "ntc.h"
+
+// ADC channel of each input
+static const uint8_t ntc_channels[NTC_COUNT] = {
+	0, // A0 -> PA2
+	1, // A1 -> PA1
+};
+
+// Written by DMA in scan order: input 0, input 1, input 0, ...
+static volatile uint16_t samples[NTC_OVERSAMPLE * NTC_COUNT];
+
+// The table has one entry every NTC_STEP codes across the usable span
+#define NTC_STEP 32
+#define NTC_STEP_SHIFT (5 + NTC_OVERSAMPLE_SHIFT) // NTC_STEP in sum units
+#define NTC_ENTRIES ((NTC_CODE_MAX - NTC_CODE_MIN) / NTC_STEP + 1)
+
+#if (NTC_CODE_MAX - NTC_CODE_MIN) % NTC_STEP
+#error NTC_CODE_MAX - NTC_CODE_MIN must be a multiple of NTC_STEP
+#endif
+
+// Thermistor resistance and 1/T at a 10 bit code. Only ever used in the
+// table initializer, where gcc folds the math to constants, so no floating
+// point code ends up in the image
+#define NTC_LN_R(code) __builtin_log(NTC_SERIES * (code) / (1024.0 - (code)))
+#ifdef NTC_SH_A
+#define NTC_INV_T(code) (NTC_SH_A + NTC_SH_B * NTC_LN_R(code) + \
+						 NTC_SH_C * NTC_LN_R(code) * NTC_LN_R(code) * NTC_LN_R(code))
+#else
+#define NTC_INV_T(code) (1.0 / NTC_T0 + (NTC_LN_R(code) - __builtin_log(NTC_R0)) / NTC_BETA)
+#endif
+#define NTC_ENTRY(i) \
+	(temp_q2_t) __builtin_floor(4.0 * (1.0 / NTC_INV_T(NTC_CODE_MIN + (i) * NTC_STEP) - 273.15) + 0.5)
+
+static const temp_q2_t ntc_table[NTC_ENTRIES] = {
+	NTC_ENTRY(0), NTC_ENTRY(1), NTC_ENTRY(2), NTC_ENTRY(3),
+	NTC_ENTRY(4), NTC_ENTRY(5), NTC_ENTRY(6), NTC_ENTRY(7),
+	NTC_ENTRY(8), NTC_ENTRY(9), NTC_ENTRY(10), NTC_ENTRY(11),
+	NTC_ENTRY(12), NTC_ENTRY(13), NTC_ENTRY(14), NTC_ENTRY(15),
+	NTC_ENTRY(16), NTC_ENTRY(17), NTC_ENTRY(18), NTC_ENTRY(19),
+	NTC_ENTRY(20), NTC_ENTRY(21), NTC_ENTRY(22), NTC_ENTRY(23),
+	NTC_ENTRY(24), NTC_ENTRY(25), NTC_ENTRY(26), NTC_ENTRY(27),
+	NTC_ENTRY(28), NTC_ENTRY(29), NTC_ENTRY(30),
+};
+
+_Static_assert(NTC_ENTRIES == sizeof(ntc_table) / sizeof(ntc_table[0]),
+			   "ntc_table needs one NTC_ENTRY per step");
+
+void ntc_init(void)
+{
+	RCC->APB2PCENR |= RCC_APB2Periph_GPIOA | RCC_APB2Periph_ADC1;
+	RCC->AHBPCENR |= RCC_AHBPeriph_DMA1;
+
+	// PA2 and PA1 as analog inputs
+	GPIOA->CFGLR &= ~((0xf << (4 * 2)) | (0xf << (4 * 1)));
+
+	// 48MHz / 8 = 6MHz ADC clock
+	RCC->CFGR0 = (RCC->CFGR0 & ~RCC_ADCPRE) | RCC_ADCPRE_DIV8;
+	RCC->APB2PRSTR |= RCC_APB2Periph_ADC1;
+	RCC->APB2PRSTR &= ~RCC_APB2Periph_ADC1;
+
+	// Scan every input in turn, longest sample time for the high
+	// impedance divider: 252 clocks, ~42us per conversion
+	ADC1->RSQR1 = (NTC_COUNT - 1) << 20;
+	ADC1->RSQR3 = 0;
+	ADC1->SAMPTR2 = 0;
+	for (uint8_t i = 0; i < NTC_COUNT; i++)
+	{
+		ADC1->RSQR3 |= ntc_channels[i] << (5 * i);
+		ADC1->SAMPTR2 |= ADC_SampleTime_241Cycles << (3 * ntc_channels[i]);
+	}
+	ADC1->CTLR1 = ADC_SCAN;
+	ADC1->CTLR2 = ADC_ADON | ADC_DMA | ADC_EXTSEL;
+
+	ADC1->CTLR2 |= ADC_RSTCAL;
+	while (ADC1->CTLR2 & ADC_RSTCAL)
+		;
+	ADC1->CTLR2 |= ADC_CAL;
+	while (ADC1->CTLR2 & ADC_CAL)
+		;
+
+	// DMA1 channel 1 is ADC1, circular over the whole buffer, no interrupt
+	DMA1_Channel1->CFGR = 0;
+	DMA1_Channel1->PADDR = (uint32_t)&ADC1->RDATAR;
+	DMA1_Channel1->MADDR = (uint32_t)samples;
+	DMA1_Channel1->CNTR = NTC_OVERSAMPLE * NTC_COUNT;
+	DMA1_Channel1->CFGR = DMA_CFGR1_PSIZE_0 | DMA_CFGR1_MSIZE_0 | DMA_CFGR1_MINC |
+						  DMA_CFGR1_CIRC | DMA_CFGR1_EN;
+
+	ADC1->CTLR2 |= ADC_CONT;
+	ADC1->CTLR2 |= ADC_SWSTART;
+}
+
+uint16_t ntc_sum(uint8_t input)
+{
+	uint16_t sum = 0;
+
+	// DMA keeps writing while this runs, every halfword is still a whole
+	// reading and they are all recent
+	for (uint8_t i = input; i < NTC_OVERSAMPLE * NTC_COUNT; i += NTC_COUNT)
+	{
+		sum += samples[i];
+	}
+	return sum;
+}
+
+ntc_status_t ntc_convert(uint16_t sum, temp_q2_t *temp)
+{
+	if (sum < (NTC_CODE_MIN << NTC_OVERSAMPLE_SHIFT))
+	{
+		return NTC_SHORT;
+	}
+	if (sum >= (NTC_CODE_MAX << NTC_OVERSAMPLE_SHIFT))
+	{
+		return NTC_OPEN;
+	}
+
+	uint16_t offset = sum - (NTC_CODE_MIN << NTC_OVERSAMPLE_SHIFT);
+	uint8_t index = offset >> NTC_STEP_SHIFT;
+	uint16_t frac = offset & ((1 << NTC_STEP_SHIFT) - 1);
+
+	// Interpolate towards the next entry, delta * frac by shifts and adds.
+	// Temperature falls as the code rises, so the next entry is lower
+	uint16_t delta = ntc_table[index] - ntc_table[index + 1];
+	uint32_t drop = 0;
+	for (uint8_t bit = 0; bit < NTC_STEP_SHIFT; bit++)
+	{
+		if (frac & (1 << bit))
+		{
+			drop += (uint32_t)delta << bit;
+		}
+	}
+	drop += 1 << (NTC_STEP_SHIFT - 1);
+
+	*temp = ntc_table[index] - (temp_q2_t)(drop >> NTC_STEP_SHIFT);
+	return NTC_OK;
+}
@@ -0,0 +1,67 @@
+#ifndef NTC_H
+#define NTC_H
+
+#include "ch32v003fun.h"
+#include "temperature.h"
+#include <stdint.h>
+
+/*
+ * NTC thermistors on the ADC.
+ * Each thermistor sits between its input and GND with NTC_SERIES ohms up to
+ * VDD. ADC1 scans every input continuously and DMA1 channel 1 stores the
+ * results round robin into a RAM buffer, NTC_OVERSAMPLE per input, with no
+ * interrupt at all. A read sums the buffer and looks the sum up in a table
+ * the compiler works out from the Beta (or Steinhart-Hart) constants below,
+ * so the only runtime math is adds and shifts.
+ *
+ * Inputs: A0 -> PA2, A1 -> PA1.
+ */
+#define NTC_COUNT 2
+#define NTC_OVERSAMPLE_SHIFT 4 // 16 samples summed per read
+#define NTC_OVERSAMPLE (1 << NTC_OVERSAMPLE_SHIFT)
+
+// Thermistor, 10k B3950 by default
+#define NTC_R0 10000.0	 // resistance at NTC_T0
+#define NTC_T0 298.15	 // 25C in kelvin
+#define NTC_BETA 3950.0
+#define NTC_SERIES 10000.0 // pull up resistor
+
+// Define all three to use Steinhart-Hart instead of Beta:
+// 1/T = A + B ln(R) + C ln(R)^3
+// #define NTC_SH_A 1.009249522e-03
+// #define NTC_SH_B 2.378405444e-04
+// #define NTC_SH_C 2.019202697e-07
+
+// Usable span of the 10 bit reading, outside it the input reads as a
+// short (low) or an open thermistor (high). About 129C down to -36C,
+// within 0.5C of the curve from -28C to 90C with the default part.
+#define NTC_CODE_MIN 32
+#define NTC_CODE_MAX 992
+
+typedef enum
+{
+	NTC_OK,
+	NTC_OPEN,
+	NTC_SHORT,
+} ntc_status_t;
+
+/**
+ * @brief Sets up the inputs and starts continuous conversion into RAM.
+ */
+void ntc_init(void);
+
+/**
+ * @brief Returns the sum of the last NTC_OVERSAMPLE readings of an input.
+ * @param input Index into the input list, below NTC_COUNT.
+ */
+uint16_t ntc_sum(uint8_t input);
+
+/**
+ * @brief Converts a reading sum from ntc_sum() to temperature.
+ * @param sum Sum of NTC_OVERSAMPLE readings.
+ * @param temp Set to the temperature when NTC_OK is returned.
+ * @return NTC_OK, or the fault when the sum is out of the usable span.
+ */
+ntc_status_t ntc_convert(uint16_t sum, temp_q2_t *temp);
+
+#endif
@@ -0,0 +1,54 @@
+#include "pid.h"
+
+void pid_reset(PidState *pid)
+{
+	pid->integral = 0;
+	pid->primed = false;
+}
+
+uint16_t pid_update(PidState *pid, const PidConfig *config, temp_q2_t setpoint, temp_q2_t measured)
+{
+	int32_t error = measured - setpoint;
+	int32_t limit = (int32_t)config->out_max << PID_SHIFT;
+
+	// Derivative on the measurement, a setpoint change does not kick it
+	int32_t slope = pid->primed ? measured - pid->last : 0;
+	pid->last = measured;
+	pid->primed = true;
+
+	int32_t kp = (int32_t)config->kp << PID_KP_SHIFT;
+	int32_t kd = (int32_t)config->kd << PID_KD_SHIFT;
+	int32_t pd = kp * error + kd * slope;
+	int32_t out = (pd + pid->integral) >> PID_SHIFT;
+
+	// Anti-windup: stop integrating while the output is pinned in the
+	// direction the error pushes, and keep the integral inside the range
+	// the output can use
+	if ((error > 0 && out < config->out_max) || (error < 0 && out > 0))
+	{
+		pid->integral += (int32_t)config->ki * error;
+		if (pid->integral > limit)
+		{
+			pid->integral = limit;
+		}
+		else if (pid->integral < 0)
+		{
+			pid->integral = 0;
+		}
+		out = (pd + pid->integral) >> PID_SHIFT;
+	}
+
+	if (out <= 0)
+	{
+		return 0;
+	}
+	if (out < config->out_min)
+	{
+		return config->out_min;
+	}
+	if (out > config->out_max)
+	{
+		return config->out_max;
+	}
+	return out;
+}
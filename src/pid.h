@@ -0,0 +1,50 @@
+#ifndef PID_H
+#define PID_H
+
+#include "temperature.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Integer PID for a cooling loop. Error is measured - setpoint in 0.25C
+ * units, so running hot drives the output up. Gains are plain integers and
+ * the sum is shifted down by PID_SHIFT, no multiply wider than 32 bits and
+ * no divide. Nothing in here touches hardware, it builds on the host.
+ *
+ * The gains are bytes, like every menu setting, and each has its own
+ * scale: a relay tune on a slow box lands kp in the hundreds and kd in the
+ * thousands, ki in single digits. kp and kd are shifted up by
+ * PID_KP_SHIFT and PID_KD_SHIFT before use, ki is taken as is.
+ */
+#define PID_SHIFT 2
+#define PID_KP_SHIFT 1 // kp 0..510 in steps of 2
+#define PID_KD_SHIFT 5 // kd 0..8160 in steps of 32
+
+typedef struct
+{
+	uint8_t kp;		   // output per 0.25C of error, << PID_KP_SHIFT >> PID_SHIFT
+	uint8_t ki;		   // added to the integral per 0.25C every update
+	uint8_t kd;		   // output per 0.25C of change, << PID_KD_SHIFT >> PID_SHIFT
+	uint16_t out_min; // lowest output while running, below this it is 0
+	uint16_t out_max; // highest output
+} PidConfig;
+
+typedef struct
+{
+	int32_t integral; // scaled by 1 << PID_SHIFT
+	temp_q2_t last;	  // measurement at the last update
+	bool primed;	  // last is valid
+} PidState;
+
+/**
+ * @brief Clears the integral and derivative history.
+ */
+void pid_reset(PidState *pid);
+
+/**
+ * @brief Runs one update, call at a fixed rate.
+ * @return 0 when the loop wants the output off, else out_min..out_max.
+ */
+uint16_t pid_update(PidState *pid, const PidConfig *config, temp_q2_t setpoint, temp_q2_t measured);
+
+#endif
@@ -0,0 +1,66 @@
+#include "scheduler.h"
+#include "systime.h"
+#include <stddef.h>
+
+static SchedTask *sched_tasks = NULL;
+static uint8_t sched_count = 0;
+
+void sched_init(SchedTask *tasks, uint8_t count)
+{
+	uint32_t now = millis();
+
+	sched_tasks = tasks;
+	sched_count = count;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		tasks[i].next_release = now;
+		tasks[i].overruns = 0;
+	}
+}
+
+uint8_t sched_run(void)
+{
+	uint8_t ran = 0;
+
+	for (uint8_t i = 0; i < sched_count; i++)
+	{
+		SchedTask *task = &sched_tasks[i];
+		uint32_t release = task->next_release;
+
+		if (!time_reached(release))
+		{
+			continue;
+		}
+
+		task->run();
+		ran++;
+
+		uint32_t done = millis();
+		if (done - release > task->deadline_ms)
+		{
+			task->overruns++;
+		}
+
+		// Skip releases we already missed instead of running the task back to back
+		release += task->period_ms;
+		while ((int32_t)(done - release) > 0)
+		{
+			release += task->period_ms;
+			task->overruns++;
+		}
+		task->next_release = release;
+	}
+
+	return ran;
+}
+
+uint32_t sched_total_overruns(void)
+{
+	uint32_t total = 0;
+
+	for (uint8_t i = 0; i < sched_count; i++)
+	{
+		total += sched_tasks[i].overruns;
+	}
+	return total;
+}
@@ -0,0 +1,40 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+/*
+ * Small cooperative scheduler.
+ * Time comes from millis(), the main loop calls sched_run() which runs
+ * every task that has been released. Nothing in here touches hardware, so
+ * it builds on the host together with systime.c in SYSTIME_HOST mode.
+ */
+
+typedef struct
+{
+	void (*run)(void);		// task body, must not block
+	uint16_t period_ms;		// release interval
+	uint16_t deadline_ms;	// max time from release to completion
+	uint32_t next_release;	// tick of the next release
+	uint16_t overruns;		// missed deadlines and skipped releases
+} SchedTask;
+
+/**
+ * @brief Sets up the task table, first release of every task is at now.
+ * @param tasks Task table, must stay valid while the scheduler runs.
+ * @param count Number of tasks in the table.
+ */
+void sched_init(SchedTask *tasks, uint8_t count);
+
+/**
+ * @brief Runs every released task once, in table order.
+ * @return Number of tasks that ran.
+ */
+uint8_t sched_run(void);
+
+/**
+ * @brief Returns the sum of overruns over all tasks.
+ */
+uint32_t sched_total_overruns(void);
+
+#endif
@@ -0,0 +1,187 @@
+#include "sensors.h"
+#include "max6675.h"
+#include "ntc.h"
+#include "systime.h"
+
+Sensor sensors[SENSOR_COUNT] = {
+	{SENSOR_MAX6675, GPIOD, 0}, // CS sensor1 -> PD0
+	{SENSOR_MAX6675, GPIOC, 0}, // CS sensor2 -> PC0
+#ifdef SENSORS_USE_NTC
+	{SENSOR_NTC, .input = 0}, // NTC sensor3 -> PA2
+	{SENSOR_NTC, .input = 1}, // NTC sensor4 -> PA1
+#endif
+};
+
+static uint8_t scan_index = 0;
+static uint8_t filter_shift = 2;
+
+// Health check and filter for one sample, a handful of compares. frame is
+// the raw reading for the stuck check, flags any read error
+static void sensors_sample(Sensor *sensor, uint16_t frame, temp_q2_t temp, uint8_t flags)
+{
+	if (flags)
+	{
+		// Nothing to compare the next good sample with
+		sensor->last_valid = false;
+	}
+	else
+	{
+		// Only accepted samples are a reference, so a spike counts once
+		// and not again on the way back
+		if (sensor->last_valid)
+		{
+			temp_q2_t step = temp - sensor->last_temp;
+			if (step > SENSOR_MAX_STEP || step < -SENSOR_MAX_STEP)
+			{
+				flags = SENSOR_FAULT_JUMP;
+			}
+		}
+		if (!flags)
+		{
+			sensor->last_temp = temp;
+			sensor->last_valid = true;
+		}
+
+		if (frame != sensor->last_frame)
+		{
+			sensor->last_frame = frame;
+			sensor->same_run = 0;
+			sensor->warning &= ~SENSOR_WARN_STUCK;
+		}
+		else if (sensor->same_run < SENSOR_STUCK_SAMPLES)
+		{
+			sensor->same_run++;
+		}
+		else
+		{
+			sensor->warning |= SENSOR_WARN_STUCK;
+		}
+	}
+
+	if (flags)
+	{
+		sensor->good_run = 0;
+		if (sensor->bad_run == 0 && sensor->faults < UINT16_MAX)
+		{
+			sensor->faults++;
+		}
+		if (sensor->bad_run < SENSOR_FAIL_SAMPLES)
+		{
+			sensor->bad_run++;
+		}
+		if (sensor->bad_run >= SENSOR_FAIL_SAMPLES &&
+			(sensor->fault == 0 || sensor->fault == SENSOR_FAULT_NO_DATA))
+		{
+			// Start over once it recovers, old samples say nothing about new ones
+			sensor->fault = flags;
+			sensor->last_valid = false;
+			filter_reset(&sensor->filter);
+		}
+	}
+	else
+	{
+		sensor->bad_run = 0;
+		sensor->raw_c4 = temp;
+		sensor->temp_c4 = filter_update(&sensor->filter, temp, filter_shift);
+		if (sensor->fault == SENSOR_FAULT_NO_DATA ||
+			(sensor->fault && ++sensor->good_run >= SENSOR_RECOVER_SAMPLES))
+		{
+			sensor->fault = 0;
+		}
+	}
+
+	sensor->timestamp = millis();
+}
+
+static void sensors_next(void)
+{
+	if (++scan_index >= SENSOR_COUNT)
+	{
+		scan_index = 0;
+	}
+}
+
+// Runs from the DMA interrupt, or inline when bit-banging
+static void sensors_read_done(uint16_t raw)
+{
+	Sensor *sensor = &sensors[scan_index];
+
+	if (raw == 0xFFFF)
+	{
+		sensors_sample(sensor, raw, 0, SENSOR_FAULT_NO_DEVICE);
+	}
+	else if (raw & MAX6675_OPEN)
+	{
+		sensors_sample(sensor, raw, 0, SENSOR_FAULT_OPEN);
+	}
+	else
+	{
+		sensors_sample(sensor, raw, raw >> 3, 0);
+	}
+	sensors_next();
+}
+
+#ifdef SENSORS_USE_NTC
+// The oversampled sum doubles as the frame for the stuck check, ADC noise
+// keeps it moving on a live input even when the temperature holds still
+static void sensors_read_ntc(Sensor *sensor)
+{
+	uint16_t sum = ntc_sum(sensor->input);
+	temp_q2_t temp = 0;
+
+	switch (ntc_convert(sum, &temp))
+	{
+	case NTC_OPEN:
+		sensors_sample(sensor, sum, 0, SENSOR_FAULT_OPEN);
+		break;
+	case NTC_SHORT:
+		sensors_sample(sensor, sum, 0, SENSOR_FAULT_SHORT);
+		break;
+	default:
+		sensors_sample(sensor, sum, temp, 0);
+		break;
+	}
+}
+#endif
+
+void sensors_init(void)
+{
+	max6675_init();
+#ifdef SENSORS_USE_NTC
+	ntc_init();
+#endif
+	for (uint8_t i = 0; i < SENSOR_COUNT; i++)
+	{
+		if (sensors[i].type == SENSOR_MAX6675)
+		{
+			max6675_init_cs(sensors[i].cs_port, sensors[i].cs_pin);
+		}
+		sensors[i].fault = SENSOR_FAULT_NO_DATA;
+	}
+}
+
+void sensors_set_filter(uint8_t shift)
+{
+	filter_shift = shift;
+}
+
+// The scheduler never releases a slot early, so each chip gets
+// SENSOR_COUNT * SENSOR_SLOT_MS >= SENSOR_CONVERSION_MS between reads
+void sensors_scan(void)
+{
+	Sensor *sensor = &sensors[scan_index];
+
+#ifdef SENSORS_USE_NTC
+	// The index only gets here once the last MAX6675 read is done
+	if (sensor->type == SENSOR_NTC)
+	{
+		sensors_read_ntc(sensor);
+		sensors_next();
+		return;
+	}
+#endif
+
+	// If the last read is still in flight the index has not moved on,
+	// this sensor is simply retried on the next slot
+	max6675_start(sensor->cs_port, sensor->cs_pin, sensors_read_done);
+}
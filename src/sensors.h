@@ -0,0 +1,102 @@
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include "ch32v003fun.h"
+#include "temperature.h"
+#include "filter.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Table of sensors: MAX6675 thermocouples sharing SCK/MISO with one CS pin
+ * each, and NTC thermistors on the ADC (see ntc.h).
+ * Each MAX6675 needs ~220ms to convert after its CS goes high, so reads are
+ * staggered one sensor per slot: every chip gets its full conversion time
+ * while the bus reads another one, and samples per second scale with
+ * SENSOR_COUNT. NTC inputs are always ready and are sampled in their slot
+ * straight from the ADC buffer.
+ *
+ * Every sample goes through a health check: a read error or a jump larger
+ * than SENSOR_MAX_STEP from the last accepted sample counts as bad. After
+ * any fault the next good sample starts the comparison over.
+ * SENSOR_FAIL_SAMPLES bad samples in a row latch the sensor failed
+ * (fault != 0), and it takes SENSOR_RECOVER_SAMPLES good ones in a row to
+ * clear it. While not failed, temp_c4 only ever holds good samples.
+ * The same frame for SENSOR_STUCK_SAMPLES samples only sets a warning: a
+ * sensor in a room that really holds still reads the same too, so that
+ * must not fail it and trip the fail safe.
+ */
+
+// Comment in to add the NTC inputs as sensors 3 and 4. Off by default, every
+// row takes a scan slot and an unpopulated input only ever reads OPEN
+// #define SENSORS_USE_NTC
+
+#ifdef SENSORS_USE_NTC
+#define SENSOR_COUNT 4
+#else
+#define SENSOR_COUNT 2
+#endif
+#define SENSOR_CONVERSION_MS 220
+#define SENSOR_SLOT_MS ((SENSOR_CONVERSION_MS + SENSOR_COUNT - 1) / SENSOR_COUNT)
+
+// Health check
+#define SENSOR_MAX_STEP TEMP_Q2(10)	 // largest believable change between samples
+#define SENSOR_STUCK_SAMPLES 1500	 // ~5.5 minutes of identical frames at 220ms
+#define SENSOR_FAIL_SAMPLES 3
+#define SENSOR_RECOVER_SAMPLES 10
+
+// Fault flags
+#define SENSOR_FAULT_OPEN 0x01	  // thermocouple input open
+#define SENSOR_FAULT_NO_DEVICE 0x02 // MISO stuck, no chip answering
+#define SENSOR_FAULT_NO_DATA 0x04	  // not read yet
+#define SENSOR_FAULT_JUMP 0x08	  // implausible step between samples
+#define SENSOR_FAULT_SHORT 0x20	  // NTC input shorted to GND
+
+// Warning flags, shown but never fail a sensor
+#define SENSOR_WARN_STUCK 0x01 // frame has not changed for a long time
+
+typedef enum
+{
+	SENSOR_MAX6675,
+	SENSOR_NTC,
+} sensor_type_t;
+
+typedef struct
+{
+	sensor_type_t type;
+	GPIO_TypeDef *cs_port;		 // MAX6675 chip select
+	uint8_t cs_pin;
+	uint8_t input;				 // NTC input index
+	volatile temp_q2_t temp_c4;	 // filtered reading, 0.25C units
+	volatile temp_q2_t raw_c4;	 // last good reading before the filter
+	TempFilter filter;
+	volatile uint32_t timestamp; // ms time of the last read
+	volatile uint8_t fault;		 // SENSOR_FAULT_ flags, 0 unless failed
+	volatile uint8_t warning;	 // SENSOR_WARN_ flags
+	uint16_t faults;			 // bad sample runs seen, saturates
+	uint16_t last_frame;		 // for the stuck check
+	uint16_t same_run;			 // samples with the same frame
+	temp_q2_t last_temp;		 // last accepted sample, for the jump check
+	bool last_valid;			 // last_temp is set, cleared by any fault
+	uint8_t bad_run;			 // bad samples in a row
+	uint8_t good_run;			 // good samples in a row
+} Sensor;
+
+extern Sensor sensors[SENSOR_COUNT];
+
+/**
+ * @brief Sets up the bus and every CS pin in the table.
+ */
+void sensors_init(void);
+
+/**
+ * @brief Sets the EMA coefficient of every sensor filter, see filter.h.
+ */
+void sensors_set_filter(uint8_t shift);
+
+/**
+ * @brief Starts a read of the next sensor in turn. Call every SENSOR_SLOT_MS.
+ */
+void sensors_scan(void);
+
+#endif
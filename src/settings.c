@@ -0,0 +1,138 @@
+#include "settings.h"
+#include "fan.h"
+#include "filter.h"
+#include "pid.h"
+#include <string.h>
+
+// Last page of the 16K flash, erased and programmed in fast page mode
+#define SETTINGS_PAGE_SIZE 64
+#define SETTINGS_PAGE (FLASH_BASE + 0x4000 - SETTINGS_PAGE_SIZE)
+#define SETTINGS_MAGIC 0x5354
+#define SETTINGS_VERSION 2 // 1 held kp and kd unscaled, see PID_KP_SHIFT
+
+typedef union
+{
+	struct
+	{
+		uint16_t magic;
+		uint8_t version;
+		uint8_t size;
+		Settings settings;
+	} record;
+	uint32_t words[SETTINGS_PAGE_SIZE / 4];
+} SettingsPage;
+
+static const Settings defaults = {
+	.temperature1 = 80,
+	.temperature2 = 90,
+	.fan_pwm = 0,
+	.kp = 24,
+	.ki = 2,
+	.kd = 0,
+	.min_duty = 20,
+	.max_duty = 100,
+	.lookahead = 0,
+	.filter = 2,
+};
+
+static void flash_wait(void)
+{
+	while (FLASH->STATR & FLASH_STATR_BSY)
+		;
+}
+
+// Holds a loaded record to the limits the menu enforces. The magic and
+// version only show the page was written, not that every field is sane
+static void settings_validate(Settings *settings)
+{
+	settings->fan_pwm &= (1 << FAN_COUNT) - 1;
+	if (settings->max_duty > SETTINGS_DUTY_MAX)
+	{
+		settings->max_duty = SETTINGS_DUTY_MAX;
+	}
+	if (settings->min_duty > settings->max_duty)
+	{
+		settings->min_duty = settings->max_duty;
+	}
+	if (settings->filter > FILTER_SHIFT_MAX)
+	{
+		settings->filter = FILTER_SHIFT_MAX;
+	}
+}
+
+void LoadSettings(Settings *settings)
+{
+	const SettingsPage *page = (const SettingsPage *)SETTINGS_PAGE;
+
+	*settings = defaults;
+
+	if (page->record.magic == SETTINGS_MAGIC && page->record.version <= SETTINGS_VERSION &&
+		page->record.size <= sizeof(Settings))
+	{
+		memcpy(settings, &page->record.settings, page->record.size);
+		if (page->record.version < 2)
+		{
+			// Same controller in the scaled units, rounded
+			settings->kp = (settings->kp + (1 << PID_KP_SHIFT >> 1)) >> PID_KP_SHIFT;
+			settings->kd = (settings->kd + (1 << PID_KD_SHIFT >> 1)) >> PID_KD_SHIFT;
+		}
+		settings_validate(settings);
+		return;
+	}
+
+	// Setpoints saved by older firmware in the option bytes
+	if ((OB->Data0 & 0xFF) != 0xFF)
+	{
+		settings->temperature1 = OB->Data0;
+	}
+	if ((OB->Data1 & 0xFF) != 0xFF)
+	{
+		settings->temperature2 = OB->Data1;
+	}
+}
+
+void SaveSettings(const Settings *settings)
+{
+	SettingsPage page;
+	uint32_t *flash = (uint32_t *)SETTINGS_PAGE;
+
+	memset(&page, 0xFF, sizeof(page));
+	page.record.magic = SETTINGS_MAGIC;
+	page.record.version = SETTINGS_VERSION;
+	page.record.size = sizeof(Settings);
+	page.record.settings = *settings;
+
+	// Spare the flash if nothing changed
+	if (memcmp(flash, &page, sizeof(page)) == 0)
+	{
+		return;
+	}
+
+	// Unlock Flash and fast page mode
+	FLASH->KEYR = FLASH_KEY1;
+	FLASH->KEYR = FLASH_KEY2;
+	FLASH->MODEKEYR = FLASH_KEY1;
+	FLASH->MODEKEYR = FLASH_KEY2;
+
+	// Erase the page
+	FLASH->CTLR = CR_PAGE_ER;
+	FLASH->ADDR = SETTINGS_PAGE;
+	FLASH->CTLR = CR_PAGE_ER | CR_STRT_Set;
+	flash_wait();
+
+	// Fill the page buffer a word at a time, then program it
+	FLASH->CTLR = CR_PAGE_PG;
+	FLASH->CTLR = CR_PAGE_PG | CR_BUF_RST;
+	flash_wait();
+	for (uint8_t i = 0; i < SETTINGS_PAGE_SIZE / 4; i++)
+	{
+		flash[i] = page.words[i];
+		FLASH->CTLR = CR_PAGE_PG | CR_BUF_LOAD;
+		flash_wait();
+	}
+	FLASH->ADDR = SETTINGS_PAGE;
+	FLASH->CTLR = CR_PAGE_PG | CR_STRT_Set;
+	flash_wait();
+
+	FLASH->CTLR = CR_LOCK_Set;
+}
@@ -0,0 +1,42 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include "ch32v003fun.h"
+#include <stdint.h>
+
+/*
+ * Persistent settings, kept in the last 64 byte page of flash. The option
+ * bytes only hold two data bytes, so they are only read once, to carry the
+ * setpoints over from older firmware. The page is only rewritten when
+ * something changed. New fields go at the end of Settings, a shorter
+ * record from older firmware loads with defaults for the rest.
+ */
+#define SETTINGS_FAN_PWM(fan) (1 << (fan)) // fan_pwm bit, 0 is relay mode
+#define SETTINGS_DUTY_MAX 100				// percent, limit of min_duty/max_duty
+
+typedef struct
+{
+	uint8_t temperature1; // First temperature threshold
+	uint8_t temperature2; // Second temperature threshold
+	uint8_t fan_pwm;	  // SETTINGS_FAN_PWM bits
+	uint8_t kp;			  // PID gains, see PidConfig
+	uint8_t ki;
+	uint8_t kd;
+	uint8_t min_duty; // fan duty limits in percent
+	uint8_t max_duty;
+	uint8_t lookahead; // seconds relay mode fans look ahead, 0 is off
+	uint8_t filter;	   // sensor EMA coefficient as a shift, 0 is off
+} Settings;
+
+/**
+ * @brief Loads the settings, defaults if the page was never written.
+ * Stored values outside the limits the menu enforces are clamped.
+ */
+void LoadSettings(Settings *settings);
+
+/**
+ * @brief Saves the settings if they differ from the stored ones.
+ */
+void SaveSettings(const Settings *settings);
+
+#endif
@@ -0,0 +1,54 @@
+#include "staging.h"
+
+void staging_init(Stage *stages, uint8_t count, uint32_t now)
+{
+	for (uint8_t i = 0; i < count; i++)
+	{
+		stages[i].active = false;
+		stages[i].written = false;
+		stages[i].changed = now - stages[i].dwell_ms;
+	}
+}
+
+void staging_update(Stage *stages, uint8_t count, stage_read_t read, uint32_t now)
+{
+	for (uint8_t i = 0; i < count; i++)
+	{
+		Stage *stage = &stages[i];
+		temp_q2_t temp;
+		bool want = stage->active;
+
+		// Something else drives the output, write it again once enabled
+		if (!stage->enabled)
+		{
+			stage->written = false;
+			continue;
+		}
+
+		// Hysteresis: the band between off and on keeps the state
+		if (read(stage->sensor, &temp))
+		{
+			if (!stage->active && temp > stage->on)
+			{
+				want = true;
+			}
+			else if (stage->active && temp < stage->off)
+			{
+				want = false;
+			}
+		}
+
+		if (want != stage->active && now - stage->changed >= stage->dwell_ms)
+		{
+			stage->active = want;
+			stage->changed = now;
+			stage->written = false;
+		}
+
+		if (!stage->written)
+		{
+			stage->output(stage->channel, stage->active);
+			stage->written = true;
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef STAGING_H
+#define STAGING_H
+
+#include "temperature.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * On/off staging table. Each stage watches one sensor and switches one
+ * output: on above its on threshold, off below its off threshold, and
+ * never sooner than its dwell time after the last change. The output is
+ * only written when the state changes. Add a row per output the board
+ * wires up, they are all evaluated in one pass.
+ */
+typedef struct
+{
+	uint8_t sensor;							  // index into sensors[]
+	temp_q2_t on;							  // switch on above, 0.25C
+	temp_q2_t off;							  // switch off below, 0.25C
+	uint32_t dwell_ms;						  // minimum time between changes
+	void (*output)(uint8_t channel, bool on); // drives the output
+	uint8_t channel;						  // passed to output
+	bool enabled;							  // false leaves the output alone
+	bool active;							  // current state
+	bool written;							  // output matches active
+	uint32_t changed;						  // ms time of the last change
+} Stage;
+
+// Reads the temperature a stage switches on, false while it is not valid
+typedef bool (*stage_read_t)(uint8_t sensor, temp_q2_t *temp);
+
+/**
+ * @brief Sets every stage off and allows a change straight away. The
+ * outputs are written on the first update.
+ */
+void staging_init(Stage *stages, uint8_t count, uint32_t now);
+
+/**
+ * @brief Evaluates every stage once. A stage whose sensor is not valid
+ * keeps its state.
+ */
+void staging_update(Stage *stages, uint8_t count, stage_read_t read, uint32_t now);
+
+#endif
@@ -0,0 +1,115 @@
+#include "systime.h"
+
+#ifdef SYSTIME_HOST
+volatile uint32_t systime_host_cnt;
+#define SYSTIME_CNT() (systime_host_cnt)
+#else
+#define SYSTIME_CNT() (SysTick->CNT)
+#endif
+
+static volatile uint32_t ms_count;	  // millis()
+static volatile uint32_t us_count;	  // micros() at the last tick
+static volatile uint32_t tick_base;	  // CNT at the last tick
+static volatile uint32_t tick_high;	  // upper 32 bits of systime_ticks()
+
+#if SYSTIME_TICKS_PER_US == 6
+#define SYSTIME_US_SHIFT 1
+#elif SYSTIME_TICKS_PER_US == 48
+#define SYSTIME_US_SHIFT 4
+#else
+#error systime expects SysTick at 6MHz or 48MHz
+#endif
+
+// n / 3 by shifts and adds, exact for all 32 bit n. Ticks per us is
+// 3 << SYSTIME_US_SHIFT, so this turns ticks into us without a divide.
+static uint32_t div3(uint32_t n)
+{
+	uint32_t q = (n >> 2) + (n >> 4);
+	q += q >> 4;
+	q += q >> 8;
+	q += q >> 16;
+	uint32_t r = n - ((q << 1) + q);
+	return q + (((r << 3) + (r << 1) + r) >> 5);
+}
+
+void systime_tick(void)
+{
+	uint32_t base = tick_base + SYSTIME_TICKS_PER_MS;
+
+	if (base < tick_base)
+	{
+		tick_high++;
+	}
+	tick_base = base;
+	us_count += 1000;
+	ms_count++;
+}
+
+uint32_t millis(void)
+{
+	return ms_count;
+}
+
+uint32_t micros(void)
+{
+	uint32_t ms, us, base, cnt;
+
+	// Retry if the tick interrupt landed between the reads
+	do
+	{
+		ms = ms_count;
+		us = us_count;
+		base = tick_base;
+		cnt = SYSTIME_CNT();
+	} while (ms != ms_count);
+
+	return us + div3((cnt - base) >> SYSTIME_US_SHIFT);
+}
+
+uint64_t systime_ticks(void)
+{
+	uint32_t ms, high, base, cnt;
+
+	do
+	{
+		ms = ms_count;
+		high = tick_high;
+		base = tick_base;
+		cnt = SYSTIME_CNT();
+	} while (ms != ms_count);
+
+	// CNT may have wrapped after the last tick, before the next one
+	if (cnt < base)
+	{
+		high++;
+	}
+	return ((uint64_t)high << 32) | cnt;
+}
+
+#ifdef SYSTIME_HOST
+
+void systime_init(void)
+{
+	tick_base = systime_host_cnt;
+}
+
+#else
+
+void systime_init(void)
+{
+	tick_base = SysTick->CNT;
+	SysTick->CMP = tick_base + SYSTIME_TICKS_PER_MS;
+	SysTick->SR = 0;
+	SysTick->CTLR |= SYSTICK_CTLR_STE | SYSTICK_CTLR_STIE;
+	NVIC_EnableIRQ(SysTicK_IRQn);
+}
+
+void SysTick_Handler(void) __attribute__((interrupt));
+void SysTick_Handler(void)
+{
+	SysTick->CMP += SYSTIME_TICKS_PER_MS;
+	SysTick->SR = 0;
+	systime_tick();
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef SYSTIME_H
+#define SYSTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Monotonic time from the SysTick compare interrupt.
+ * SysTick->CNT keeps free running (Delay_Us/Delay_Ms rely on it), the
+ * interrupt fires every millisecond, bumps the counters and extends CNT to
+ * 64 bits. All 32 bit values wrap, compare them with the helpers below.
+ *
+ * Define SYSTIME_HOST to build off target: systime_host_cnt stands in for
+ * SysTick->CNT and the test calls systime_tick() in place of the interrupt.
+ */
+#ifdef SYSTIME_HOST
+#define SYSTIME_TICKS_PER_US 6
+extern volatile uint32_t systime_host_cnt;
+#else
+#include "ch32v003fun.h"
+#define SYSTIME_TICKS_PER_US DELAY_US_TIME
+#endif
+#define SYSTIME_TICKS_PER_MS (SYSTIME_TICKS_PER_US * 1000)
+
+/**
+ * @brief Starts the 1ms SysTick compare interrupt.
+ */
+void systime_init(void);
+
+/**
+ * @brief Interrupt body, advances time by one millisecond.
+ */
+void systime_tick(void);
+
+/**
+ * @brief Milliseconds since systime_init(), wraps after ~49 days.
+ */
+uint32_t millis(void);
+
+/**
+ * @brief Microseconds since systime_init(), wraps after ~71 minutes.
+ */
+uint32_t micros(void);
+
+/**
+ * @brief Raw SysTick count extended to 64 bits, never wraps in practice.
+ */
+uint64_t systime_ticks(void);
+
+// Time passed since a millis()/micros() stamp, correct across the wrap
+static inline uint32_t elapsed_ms(uint32_t since)
+{
+	return millis() - since;
+}
+
+static inline uint32_t elapsed_us(uint32_t since)
+{
+	return micros() - since;
+}
+
+// true once millis() has reached deadline, correct across the wrap
+// as long as the deadline is less than ~24 days away
+static inline bool time_reached(uint32_t deadline)
+{
+	return (int32_t)(millis() - deadline) >= 0;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "tach.h"
+
+// SysTick ticks per revolution at 1 RPM, fits 32 bits up to a 48MHz SysTick
+#define TACH_TICKS_PER_REV_MIN (60UL * DELAY_US_TIME * 1000000 / TACH_PULSES_PER_REV)
+
+typedef struct
+{
+	GPIO_TypeDef *port; // must be GPIOD, see tach_init()
+	uint8_t pin;		// also the EXTI line
+	volatile uint32_t first; // SysTick->CNT at the first edge of the window
+	volatile uint32_t last;	 // and at the latest edge
+	volatile uint16_t edges; // edges in the window
+	uint16_t rpm;
+	bool present;
+} TachChannel;
+
+// In fan order
+static TachChannel tach[FAN_COUNT] = {
+	{GPIOD, 5},
+	{GPIOD, 6},
+};
+
+void tach_init(void)
+{
+	RCC->APB2PCENR |= RCC_APB2Periph_GPIOD | RCC_APB2Periph_AFIO;
+
+	for (uint8_t i = 0; i < FAN_COUNT; i++)
+	{
+		uint8_t pin = tach[i].pin;
+
+		// Input with pull-up
+		tach[i].port->CFGLR &= ~(0xF << (4 * pin));
+		tach[i].port->CFGLR |= GPIO_CNF_IN_PUPD << (4 * pin);
+		tach[i].port->BSHR = 1 << pin;
+
+		// EXTI line from port D, falling edge
+		AFIO->EXTICR = (AFIO->EXTICR & ~(0x3 << (2 * pin))) | (0x3 << (2 * pin));
+		EXTI->FTENR |= 1 << pin;
+		EXTI->INTENR |= 1 << pin;
+	}
+
+	NVIC_EnableIRQ(EXTI7_0_IRQn);
+}
+
+void tach_update(void)
+{
+	for (uint8_t i = 0; i < FAN_COUNT; i++)
+	{
+		TachChannel *ch = &tach[i];
+
+		__disable_irq();
+		uint16_t edges = ch->edges;
+		uint32_t first = ch->first;
+		uint32_t last = ch->last;
+		// Carry the latest edge into the next window so no period is lost
+		// between windows. A window without a period starts empty.
+		ch->first = last;
+		ch->edges = edges >= 2 ? 1 : 0;
+		__enable_irq();
+
+		if (edges < 2 || last == first)
+		{
+			ch->rpm = 0;
+			continue;
+		}
+
+		// Mean period, then RPM from it, two 32 bit divides instead of one
+		// 64 bit one. Dropping the fraction of a tick from the period is
+		// under 0.1% even at kHz edge rates
+		uint32_t periods = edges - 1;
+		uint32_t period = ((last - first) + (periods >> 1)) / periods;
+		uint32_t rpm = period ? (TACH_TICKS_PER_REV_MIN + (period >> 1)) / period : UINT32_MAX;
+		ch->rpm = rpm > UINT16_MAX ? UINT16_MAX : rpm;
+		ch->present = true;
+	}
+}
+
+uint16_t tach_rpm(uint8_t fan)
+{
+	return tach[fan].rpm;
+}
+
+bool tach_present(uint8_t fan)
+{
+	return tach[fan].present;
+}
+
+void tach_edge(uint32_t pending, uint32_t now)
+{
+	for (uint8_t i = 0; i < FAN_COUNT; i++)
+	{
+		TachChannel *ch = &tach[i];
+
+		if (pending & (1 << ch->pin))
+		{
+			if (ch->edges == 0)
+			{
+				ch->first = now;
+			}
+			// Once the count saturates last stays put too, so first to
+			// last is still edges - 1 periods
+			if (ch->edges != UINT16_MAX)
+			{
+				ch->edges++;
+				ch->last = now;
+			}
+		}
+	}
+}
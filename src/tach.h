@@ -0,0 +1,48 @@
+#ifndef TACH_H
+#define TACH_H
+
+#include "ch32v003fun.h"
+#include "fan.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Fan tachometers on EXTI, FAN1 on PD5 and FAN2 on PD6, falling edges of
+ * the open collector tach line (pulled up). The interrupt only stamps the
+ * edge with SysTick->CNT and counts it. tach_update() turns the first and
+ * last stamp of each window into RPM, so the result is a period
+ * measurement averaged over every edge in the window, not an edge count,
+ * and the cost per edge stays a few instructions at kHz rates.
+ */
+#define TACH_PULSES_PER_REV 2 // standard PC fan
+
+/**
+ * @brief Sets up the tach pins and their EXTI lines.
+ */
+void tach_init(void);
+
+/**
+ * @brief Edge interrupt body, called from the EXTI handler.
+ * @param pending EXTI lines that fired.
+ * @param now SysTick->CNT at the interrupt.
+ */
+void tach_edge(uint32_t pending, uint32_t now);
+
+/**
+ * @brief Closes the measuring window and updates the RPM. Call at a fixed
+ * rate, a window needs at least two edges to give a non zero RPM.
+ */
+void tach_update(void);
+
+/**
+ * @brief RPM from the last window.
+ */
+uint16_t tach_rpm(uint8_t fan);
+
+/**
+ * @brief true once a fan has been seen spinning, fans without a tach
+ * wire never are.
+ */
+bool tach_present(uint8_t fan);
+
+#endif
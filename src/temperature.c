@@ -0,0 +1,45 @@
+#include "temperature.h"
+
+// n / 5 by shifts and adds, exact for n < 400000 which covers 9 * INT16_MAX
+static uint32_t div5(uint32_t n)
+{
+	uint32_t q = (n >> 1) + (n >> 2);
+	q += q >> 4;
+	q += q >> 8;
+	q >>= 2;
+	uint32_t r = n - ((q << 2) + q);
+	return q + (((r << 3) - r) >> 5);
+}
+
+// n / 9 by shifts and adds, exact for n < 600000
+static uint32_t div9(uint32_t n)
+{
+	uint32_t q = n - (n >> 3);
+	q += q >> 6;
+	q += q >> 12;
+	q >>= 3;
+	uint32_t r = n - ((q << 3) + q);
+	return q + ((r + 7) >> 4);
+}
+
+temp_q2_t temp_c_to_f(temp_q2_t c)
+{
+	// F = C * 9 / 5 + 32, rounded half away from zero
+	uint32_t mag = c < 0 ? -c : c;
+	mag = div5((mag << 3) + mag + 2);
+	return (c < 0 ? -(temp_q2_t)mag : (temp_q2_t)mag) + TEMP_Q2(32);
+}
+
+temp_q2_t temp_f_to_c(temp_q2_t f)
+{
+	// C = (F - 32) * 5 / 9, rounded half away from zero
+	int32_t d = f - TEMP_Q2(32);
+	uint32_t mag = d < 0 ? -d : d;
+	mag = div9((mag << 2) + mag + 4);
+	return d < 0 ? -(temp_q2_t)mag : (temp_q2_t)mag;
+}
+
+int16_t temp_round(temp_q2_t t)
+{
+	return (t + 2) >> 2;
+}
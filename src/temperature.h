@@ -0,0 +1,35 @@
+#ifndef TEMPERATURE_H
+#define TEMPERATURE_H
+
+#include <stdint.h>
+
+/*
+ * Integer temperature math in quarter degree units, the native MAX6675
+ * resolution. The CH32V003 is rv32ec: no hardware multiply or divide and no
+ * FPU, so everything here is shifts and adds, nothing pulls in libgcc's
+ * soft-float or division routines.
+ */
+
+typedef int16_t temp_q2_t; // temperature in 0.25 degree steps
+
+#define TEMP_Q2(deg) ((temp_q2_t)((deg) * 4))
+
+// Longest string from fmt_temp() unpadded, "-1234.75" plus terminator
+#define TEMP_STR_LEN 9
+
+/**
+ * @brief Converts Celsius to Fahrenheit, rounded to the nearest quarter.
+ */
+temp_q2_t temp_c_to_f(temp_q2_t c);
+
+/**
+ * @brief Converts Fahrenheit to Celsius, rounded to the nearest quarter.
+ */
+temp_q2_t temp_f_to_c(temp_q2_t f);
+
+/**
+ * @brief Rounds to whole degrees, halves round up.
+ */
+int16_t temp_round(temp_q2_t t);
+
+#endif
@@ -0,0 +1,83 @@
+#include "trend.h"
+
+void trend_reset(Trend *trend)
+{
+	trend->head = 0;
+	trend->count = 0;
+}
+
+void trend_add(Trend *trend, uint32_t time_ms, temp_q2_t temp)
+{
+	trend->time[trend->head] = time_ms;
+	trend->temp[trend->head] = temp;
+	trend->head = (trend->head + 1) & (TREND_SAMPLES - 1);
+	if (trend->count < TREND_SAMPLES)
+	{
+		trend->count++;
+	}
+}
+
+bool trend_project(const Trend *trend, uint32_t horizon_ms, temp_q2_t *projected)
+{
+	if (trend->count < TREND_SAMPLES)
+	{
+		return false;
+	}
+
+	// Times relative to the newest sample (u <= 0), keeps the sums small
+	// and makes the wrap of millis() harmless
+	uint32_t newest = trend->time[(trend->head - 1) & (TREND_SAMPLES - 1)];
+	uint32_t oldest = trend->time[trend->head];
+	if (newest - oldest > TREND_SPAN_MAX_MS)
+	{
+		return false;
+	}
+
+	// With |u| < 2^16 and |temp| < 2^15: |sxx| < 2^38, |sxy| < 2^38 and
+	// |num| < 2^61, den << 15 < 2^56, nothing below overflows
+	int64_t su = 0, suu = 0, st = 0, sut = 0;
+	for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+	{
+		int32_t u = (int32_t)(trend->time[i] - newest);
+		su += u;
+		suu += (int64_t)u * u;
+		st += trend->temp[i];
+		sut += (int64_t)u * trend->temp[i];
+	}
+
+	// slope = sxy / sxx, and the line passes through the means, so at
+	// u = h: T = (st + slope * (n*h - su)) / n
+	const int64_t n = TREND_SAMPLES;
+	int64_t sxx = n * suu - su * su;
+	int64_t sxy = n * sut - su * st;
+	if (sxx <= 0)
+	{
+		return false; // all samples at the same time
+	}
+
+	int64_t num = st * sxx + sxy * (n * (int64_t)horizon_ms - su);
+	int64_t den = n * sxx;
+
+	// Round half away from zero, on the magnitude
+	uint64_t mag = (num < 0 ? -(uint64_t)num : (uint64_t)num) + (den >> 1);
+	if (mag >= (uint64_t)den << 15)
+	{
+		*projected = num < 0 ? INT16_MIN : INT16_MAX;
+		return true;
+	}
+
+	// The quotient fits in 15 bits, so shift and subtract takes 15 steps
+	// of adds and shifts, where num / den would call libgcc's __divdi3
+	uint16_t t = 0;
+	for (int8_t bit = 14; bit >= 0; bit--)
+	{
+		uint64_t part = (uint64_t)den << bit;
+		if (mag >= part)
+		{
+			mag -= part;
+			t |= 1 << bit;
+		}
+	}
+	*projected = num < 0 ? -(temp_q2_t)t : (temp_q2_t)t;
+	return true;
+}
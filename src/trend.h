@@ -0,0 +1,44 @@
+#ifndef TREND_H
+#define TREND_H
+
+#include "temperature.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Rate of change of a temperature from the last TREND_SAMPLES timestamped
+ * samples, by least squares on integers: times in ms, temperatures in
+ * 0.25C, 64 bit sums and a shift and subtract divide, so no libgcc divide
+ * gets linked in. Samples do not need to be evenly spaced. Hardware free.
+ */
+#define TREND_SAMPLES 8			// power of 2
+#define TREND_SPAN_MAX_MS 65535 // older windows give no projection, bounds the sums
+
+typedef struct
+{
+	uint32_t time[TREND_SAMPLES]; // ms
+	temp_q2_t temp[TREND_SAMPLES];
+	uint8_t head;  // next slot to write
+	uint8_t count; // valid samples
+} Trend;
+
+/**
+ * @brief Drops all samples.
+ */
+void trend_reset(Trend *trend);
+
+/**
+ * @brief Adds a sample, the oldest drops out once the window is full.
+ */
+void trend_add(Trend *trend, uint32_t time_ms, temp_q2_t temp);
+
+/**
+ * @brief Projects the fitted line horizon_ms past the newest sample,
+ * saturated to the temp_q2_t range.
+ * @param horizon_ms At most 2^20, about 17 minutes.
+ * @return false until the window is full, or once it spans more than
+ * TREND_SPAN_MAX_MS.
+ */
+bool trend_project(const Trend *trend, uint32_t horizon_ms, temp_q2_t *projected);
+
+#endif
@@ -0,0 +1,34 @@
+#include "temperature.h"
+
+/*
+ * Target side of "make bench": built for rv32ec with the firmware's
+ * toolchain and run in rvsim, never on the host. Each function takes a
+ * MAX6675 frame and returns the whole degrees the display shows, the way
+ * the firmware got there before and after the quarter degree math.
+ */
+
+// Before: readSensors() in the original main.c, whole degrees and
+// Fahrenheit through double precision
+uint16_t bench_old_c(uint16_t raw)
+{
+	uint16_t value = (raw >> 3) / 4;
+	return value;
+}
+
+uint16_t bench_old_f(uint16_t raw)
+{
+	uint16_t value = (raw >> 3) / 4;
+	value = (value * 9.0 / 5.0) + 32;
+	return value;
+}
+
+// After: sensorTemp() and the rounding in fmt_temp()
+int16_t bench_new_c(uint16_t raw)
+{
+	return temp_round(raw >> 3);
+}
+
+int16_t bench_new_f(uint16_t raw)
+{
+	return temp_round(temp_c_to_f(raw >> 3));
+}
@@ -0,0 +1,62 @@
+#ifndef PLANT_H
+#define PLANT_H
+
+#include "temperature.h"
+#include <stdint.h>
+#include <math.h>
+
+/*
+ * First order thermal plant for the control simulations. A constant heat
+ * load warms the enclosure, losses to ambient scale with the temperature
+ * difference and the fan adds to them in proportion to its duty. The
+ * sensor sees the temperature through a dead time and in 0.25C steps, like
+ * the MAX6675. One step is one second.
+ */
+#define PLANT_DELAY_MAX 64
+
+typedef struct
+{
+	double temp;	 // C
+	double ambient;	 // C
+	double heat;	 // C/s from the load
+	double loss;	 // 1/s to ambient with the fan off
+	double fan_loss; // 1/s more at full duty
+	uint8_t delay;	 // sensor dead time in steps, below PLANT_DELAY_MAX
+	double seen[PLANT_DELAY_MAX];
+	uint8_t head;
+} Plant;
+
+// A box that settles at 85C with the fans off and 37C with them at full
+// speed, 10 minute time constant, 10s sensor lag
+static inline void plant_init(Plant *plant, double temp)
+{
+	plant->temp = temp;
+	plant->ambient = 25;
+	plant->heat = 0.1;
+	plant->loss = 1.0 / 600;
+	plant->fan_loss = 4.0 / 600;
+	plant->delay = 10;
+	for (uint8_t i = 0; i < PLANT_DELAY_MAX; i++)
+	{
+		plant->seen[i] = temp;
+	}
+	plant->head = 0;
+}
+
+// Advances one second with the fan at duty (0..1)
+static inline void plant_step(Plant *plant, double duty)
+{
+	double loss = plant->loss + plant->fan_loss * duty;
+	plant->temp += plant->heat - loss * (plant->temp - plant->ambient);
+	plant->seen[plant->head] = plant->temp;
+	plant->head = (plant->head + 1) % PLANT_DELAY_MAX;
+}
+
+// What the sensor reads now, quarter degrees
+static inline temp_q2_t plant_read(const Plant *plant)
+{
+	uint8_t i = (plant->head + PLANT_DELAY_MAX - 1 - plant->delay) % PLANT_DELAY_MAX;
+	return (temp_q2_t)floor(plant->seen[i] * 4);
+}
+
+#endif
@@ -0,0 +1,76 @@
+#include "rvsim.h"
+#include <stdio.h>
+
+/*
+ * Runs functions of a target image in rvsim over every MAX6675 reading,
+ * 0C to 1023.75C, and prints the instructions each took and the calls
+ * they made per run, libgcc routines included:
+ *
+ *     ./rvbench bench_temperature.elf bench_old_f bench_new_f
+ *
+ * Counts are instructions retired, not cycles: rvsim has no pipeline or
+ * flash wait states, so compare paths with it rather than time them.
+ */
+#define BENCH_READINGS 4096 // 12 bit reading, the frame holds it << 3
+
+int main(int argc, char **argv)
+{
+	static RvCpu cpu;
+
+	if (argc < 3)
+	{
+		printf("usage: %s image.elf function...\n", argv[0]);
+		return 2;
+	}
+	if (!rv_load_elf(&cpu, argv[1]))
+	{
+		printf("%s: %s\n", argv[1], cpu.error);
+		return 1;
+	}
+
+	for (int i = 2; i < argc; i++)
+	{
+		RvFunc *func = rv_find(&cpu, argv[i]);
+		if (!func)
+		{
+			printf("%s: no such function\n", argv[i]);
+			rv_free(&cpu);
+			return 1;
+		}
+
+		for (uint16_t j = 0; j < cpu.func_count; j++)
+		{
+			cpu.funcs[j].calls = 0;
+		}
+		uint64_t total = 0, low = UINT64_MAX, high = 0;
+		for (uint32_t reading = 0; reading < BENCH_READINGS; reading++)
+		{
+			uint64_t start = cpu.instret;
+			uint32_t ret;
+			if (!rv_call(&cpu, func->addr, reading << 3, &ret))
+			{
+				printf("%s(%u): %s at %08x\n", func->name, reading << 3, cpu.error, cpu.pc);
+				rv_free(&cpu);
+				return 1;
+			}
+			uint64_t count = cpu.instret - start;
+			total += count;
+			low = count < low ? count : low;
+			high = count > high ? count : high;
+		}
+
+		printf("%-16s %6.1f instructions (%llu..%llu)", func->name, (double)total / BENCH_READINGS,
+			   (unsigned long long)low, (unsigned long long)high);
+		for (uint16_t j = 0; j < cpu.func_count; j++)
+		{
+			if (cpu.funcs[j].calls)
+			{
+				printf(", %s x%.2f", cpu.funcs[j].name, (double)cpu.funcs[j].calls / BENCH_READINGS);
+			}
+		}
+		printf("\n");
+	}
+
+	rv_free(&cpu);
+	return 0;
+}
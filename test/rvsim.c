@@ -0,0 +1,727 @@
+#include "rvsim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Returning to this address ends rv_call(), it is never inside memory
+#define RV_RETURN 0xFFFFFFF0UL
+
+// Register numbers of the calling convention
+#define RV_RA 1
+#define RV_SP 2
+#define RV_GP 3
+#define RV_A0 10
+
+// Bits hi..lo of an instruction, shifted down
+#define BITS(insn, hi, lo) (((insn) >> (lo)) & ((1UL << ((hi) - (lo) + 1)) - 1))
+
+static int32_t sign_extend(uint32_t value, uint8_t bits)
+{
+	uint32_t sign = 1UL << (bits - 1);
+	return (int32_t)((value ^ sign) - sign);
+}
+
+bool rv_init(RvCpu *cpu, uint32_t base, uint32_t size)
+{
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->mem = calloc(size, 1);
+	if (!cpu->mem)
+	{
+		cpu->error = "out of memory";
+		return false;
+	}
+	cpu->base = base;
+	cpu->size = size;
+	return true;
+}
+
+void rv_free(RvCpu *cpu)
+{
+	free(cpu->mem);
+	cpu->mem = NULL;
+}
+
+static uint8_t *rv_addr(RvCpu *cpu, uint32_t addr, uint32_t len)
+{
+	uint32_t offset = addr - cpu->base;
+	if (offset >= cpu->size || cpu->size - offset < len)
+	{
+		return NULL;
+	}
+	return cpu->mem + offset;
+}
+
+bool rv_write(RvCpu *cpu, uint32_t addr, const void *data, uint32_t len)
+{
+	uint8_t *p = rv_addr(cpu, addr, len);
+	if (!p)
+	{
+		return false;
+	}
+	memcpy(p, data, len);
+	return true;
+}
+
+bool rv_add_func(RvCpu *cpu, const char *name, uint32_t addr)
+{
+	if (cpu->func_count >= RV_FUNCS_MAX)
+	{
+		return false;
+	}
+	RvFunc *func = &cpu->funcs[cpu->func_count++];
+	snprintf(func->name, sizeof(func->name), "%s", name);
+	func->addr = addr;
+	func->calls = 0;
+	return true;
+}
+
+RvFunc *rv_find(RvCpu *cpu, const char *name)
+{
+	for (uint16_t i = 0; i < cpu->func_count; i++)
+	{
+		if (strcmp(cpu->funcs[i].name, name) == 0)
+		{
+			return &cpu->funcs[i];
+		}
+	}
+	return NULL;
+}
+
+// ELF32 little endian, only the fields the loader needs
+typedef struct
+{
+	uint8_t ident[16];
+	uint16_t type, machine;
+	uint32_t version, entry, phoff, shoff, flags;
+	uint16_t ehsize, phentsize, phnum, shentsize, shnum, shstrndx;
+} Elf32Header;
+
+typedef struct
+{
+	uint32_t type, offset, vaddr, paddr, filesz, memsz, flags, align;
+} Elf32Segment;
+
+typedef struct
+{
+	uint32_t name, type, flags, addr, offset, size, link, info, addralign, entsize;
+} Elf32Section;
+
+typedef struct
+{
+	uint32_t name, value, size;
+	uint8_t info, other;
+	uint16_t shndx;
+} Elf32Symbol;
+
+#define ELF_EXEC 2
+#define ELF_RISCV 243
+#define ELF_PT_LOAD 1
+#define ELF_SHT_SYMTAB 2
+#define ELF_STT_FUNC 2
+
+static bool rv_load_symbols(RvCpu *cpu, const uint8_t *file, long len, const Elf32Header *header)
+{
+	const Elf32Section *sections = (const Elf32Section *)(file + header->shoff);
+
+	for (uint16_t i = 0; i < header->shnum; i++)
+	{
+		const Elf32Section *symtab = &sections[i];
+		if (symtab->type != ELF_SHT_SYMTAB || symtab->link >= header->shnum)
+		{
+			continue;
+		}
+		const Elf32Section *strtab = &sections[symtab->link];
+		if ((long)(symtab->offset + symtab->size) > len || (long)(strtab->offset + strtab->size) > len)
+		{
+			return false;
+		}
+
+		const Elf32Symbol *symbols = (const Elf32Symbol *)(file + symtab->offset);
+		for (uint32_t j = 0; j < symtab->size / sizeof(Elf32Symbol); j++)
+		{
+			const char *name = (const char *)file + strtab->offset + symbols[j].name;
+			if (symbols[j].name >= strtab->size)
+			{
+				continue;
+			}
+			if ((symbols[j].info & 0xF) == ELF_STT_FUNC)
+			{
+				rv_add_func(cpu, name, symbols[j].value);
+			}
+			else if (strcmp(name, "__global_pointer$") == 0)
+			{
+				cpu->x[RV_GP] = symbols[j].value;
+			}
+		}
+	}
+	return true;
+}
+
+bool rv_load_elf(RvCpu *cpu, const char *path)
+{
+	static const char *bad = "not a 32 bit RISC-V executable";
+	uint8_t *file = NULL;
+	long len = 0;
+	bool ok = false;
+
+	FILE *f = fopen(path, "rb");
+	if (f && fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) > 0 && fseek(f, 0, SEEK_SET) == 0)
+	{
+		file = malloc(len);
+		if (file && fread(file, 1, len, f) != (size_t)len)
+		{
+			free(file);
+			file = NULL;
+		}
+	}
+	if (f)
+	{
+		fclose(f);
+	}
+	if (!file)
+	{
+		memset(cpu, 0, sizeof(*cpu));
+		cpu->error = "cannot read the file";
+		return false;
+	}
+
+	const Elf32Header *header = (const Elf32Header *)file;
+	if (len < (long)sizeof(*header) || memcmp(header->ident, "\177ELF\1\1", 6) != 0 ||
+		header->type != ELF_EXEC || header->machine != ELF_RISCV ||
+		(long)(header->phoff + header->phnum * sizeof(Elf32Segment)) > len ||
+		(long)(header->shoff + header->shnum * sizeof(Elf32Section)) > len)
+	{
+		memset(cpu, 0, sizeof(*cpu));
+		cpu->error = bad;
+		free(file);
+		return false;
+	}
+
+	const Elf32Segment *segments = (const Elf32Segment *)(file + header->phoff);
+	uint32_t low = UINT32_MAX, high = 0;
+
+	// One block from the lowest segment to the stack above the highest
+	for (uint16_t i = 0; i < header->phnum; i++)
+	{
+		if (segments[i].type == ELF_PT_LOAD && segments[i].memsz)
+		{
+			if (segments[i].vaddr < low)
+			{
+				low = segments[i].vaddr;
+			}
+			if (segments[i].vaddr + segments[i].memsz > high)
+			{
+				high = segments[i].vaddr + segments[i].memsz;
+			}
+		}
+	}
+	if (low >= high)
+	{
+		memset(cpu, 0, sizeof(*cpu));
+		cpu->error = bad;
+		goto done;
+	}
+	if (!rv_init(cpu, low, high - low + RV_STACK_SIZE))
+	{
+		goto done;
+	}
+
+	for (uint16_t i = 0; i < header->phnum; i++)
+	{
+		const Elf32Segment *segment = &segments[i];
+		if (segment->type != ELF_PT_LOAD || !segment->filesz)
+		{
+			continue;
+		}
+		if ((long)(segment->offset + segment->filesz) > len || segment->filesz > segment->memsz ||
+			!rv_write(cpu, segment->vaddr, file + segment->offset, segment->filesz))
+		{
+			cpu->error = bad;
+			goto done;
+		}
+	}
+
+	if (!rv_load_symbols(cpu, file, len, header))
+	{
+		cpu->error = bad;
+		goto done;
+	}
+	ok = true;
+
+done:
+	free(file);
+	if (!ok)
+	{
+		rv_free(cpu);
+	}
+	return ok;
+}
+
+// Register access. RV32E has x0..x15, anything above is illegal
+#define REG_OK(r) ((r) < 16)
+
+static bool rv_load(RvCpu *cpu, uint32_t addr, uint8_t width, bool sign, uint32_t *value)
+{
+	uint8_t *p = rv_addr(cpu, addr, width);
+	if (!p)
+	{
+		cpu->error = "load outside memory";
+		return false;
+	}
+	uint32_t v = p[0];
+	if (width > 1)
+	{
+		v |= (uint32_t)p[1] << 8;
+	}
+	if (width > 2)
+	{
+		v |= (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+	}
+	*value = sign && width < 4 ? (uint32_t)sign_extend(v, width * 8) : v;
+	return true;
+}
+
+static bool rv_store(RvCpu *cpu, uint32_t addr, uint8_t width, uint32_t value)
+{
+	uint8_t *p = rv_addr(cpu, addr, width);
+	if (!p)
+	{
+		cpu->error = "store outside memory";
+		return false;
+	}
+	for (uint8_t i = 0; i < width; i++)
+	{
+		p[i] = value >> (8 * i);
+	}
+	return true;
+}
+
+// Jumps, counting a call when the link goes to ra
+static void rv_jump(RvCpu *cpu, uint8_t rd, uint32_t target, uint32_t link)
+{
+	if (rd == RV_RA)
+	{
+		for (uint16_t i = 0; i < cpu->func_count; i++)
+		{
+			if (cpu->funcs[i].addr == target)
+			{
+				cpu->funcs[i].calls++;
+				break;
+			}
+		}
+	}
+	if (rd)
+	{
+		cpu->x[rd] = link;
+	}
+	cpu->pc = target;
+}
+
+static uint32_t rv_alu(uint8_t funct3, bool alt, uint32_t a, uint32_t b)
+{
+	switch (funct3)
+	{
+	case 0:
+		return alt ? a - b : a + b;
+	case 1:
+		return a << (b & 31);
+	case 2:
+		return (int32_t)a < (int32_t)b;
+	case 3:
+		return a < b;
+	case 4:
+		return a ^ b;
+	case 5:
+		return alt ? (uint32_t)((int32_t)a >> (b & 31)) : a >> (b & 31);
+	case 6:
+		return a | b;
+	default:
+		return a & b;
+	}
+}
+
+static bool rv_branch(uint8_t funct3, uint32_t a, uint32_t b)
+{
+	switch (funct3)
+	{
+	case 0:
+		return a == b;
+	case 1:
+		return a != b;
+	case 4:
+		return (int32_t)a < (int32_t)b;
+	case 5:
+		return (int32_t)a >= (int32_t)b;
+	case 6:
+		return a < b;
+	default:
+		return a >= b;
+	}
+}
+
+static bool rv_step32(RvCpu *cpu, uint32_t insn)
+{
+	uint8_t rd = BITS(insn, 11, 7);
+	uint8_t rs1 = BITS(insn, 19, 15);
+	uint8_t rs2 = BITS(insn, 24, 20);
+	uint8_t funct3 = BITS(insn, 14, 12);
+	uint8_t funct7 = BITS(insn, 31, 25);
+	int32_t imm_i = sign_extend(BITS(insn, 31, 20), 12);
+	int32_t imm_s = sign_extend(BITS(insn, 31, 25) << 5 | BITS(insn, 11, 7), 12);
+	uint32_t next = cpu->pc + 4;
+	uint32_t value;
+
+	// Only the fields the format has, the rest are immediate bits
+	uint8_t opcode = BITS(insn, 6, 0);
+	bool has_rd = opcode != 0x63 && opcode != 0x23;
+	bool has_rs1 = opcode != 0x37 && opcode != 0x17 && opcode != 0x6F;
+	bool has_rs2 = opcode == 0x63 || opcode == 0x23 || opcode == 0x33;
+	if ((has_rd && !REG_OK(rd)) || (has_rs1 && !REG_OK(rs1)) || (has_rs2 && !REG_OK(rs2)))
+	{
+		cpu->error = "register above x15";
+		return false;
+	}
+
+	switch (opcode)
+	{
+	case 0x37: // lui
+		value = insn & 0xFFFFF000UL;
+		break;
+	case 0x17: // auipc
+		value = cpu->pc + (insn & 0xFFFFF000UL);
+		break;
+	case 0x6F: // jal
+	{
+		uint32_t offset = BITS(insn, 31, 31) << 20 | BITS(insn, 19, 12) << 12 |
+						  BITS(insn, 20, 20) << 11 | BITS(insn, 30, 21) << 1;
+		rv_jump(cpu, rd, cpu->pc + sign_extend(offset, 21), next);
+		return true;
+	}
+	case 0x67: // jalr
+		if (funct3)
+		{
+			goto illegal;
+		}
+		rv_jump(cpu, rd, (cpu->x[rs1] + imm_i) & ~1UL, next);
+		return true;
+	case 0x63: // branches
+	{
+		if (funct3 == 2 || funct3 == 3)
+		{
+			goto illegal;
+		}
+		uint32_t offset = BITS(insn, 31, 31) << 12 | BITS(insn, 7, 7) << 11 |
+						  BITS(insn, 30, 25) << 5 | BITS(insn, 11, 8) << 1;
+		cpu->pc = rv_branch(funct3, cpu->x[rs1], cpu->x[rs2]) ? cpu->pc + sign_extend(offset, 13) : next;
+		return true;
+	}
+	case 0x03: // loads
+		if (funct3 == 3 || funct3 > 5)
+		{
+			goto illegal;
+		}
+		if (!rv_load(cpu, cpu->x[rs1] + imm_i, 1 << (funct3 & 3), !(funct3 & 4), &value))
+		{
+			return false;
+		}
+		break;
+	case 0x23: // stores
+		if (funct3 > 2)
+		{
+			goto illegal;
+		}
+		if (!rv_store(cpu, cpu->x[rs1] + imm_s, 1 << funct3, cpu->x[rs2]))
+		{
+			return false;
+		}
+		cpu->pc = next;
+		return true;
+	case 0x13: // immediate ALU
+		if (funct3 == 1 && funct7)
+		{
+			goto illegal;
+		}
+		if (funct3 == 5 && (funct7 & ~0x20))
+		{
+			goto illegal;
+		}
+		value = rv_alu(funct3, funct3 == 5 && funct7 == 0x20, cpu->x[rs1],
+					   funct3 == 1 || funct3 == 5 ? rs2 : (uint32_t)imm_i);
+		break;
+	case 0x33: // register ALU, funct7 1 is the M extension the core lacks
+		if (funct7 != 0 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5)))
+		{
+			goto illegal;
+		}
+		value = rv_alu(funct3, funct7 == 0x20, cpu->x[rs1], cpu->x[rs2]);
+		break;
+	case 0x0F: // fence, nothing to order here
+		cpu->pc = next;
+		return true;
+	case 0x73:
+		cpu->error = insn == 0x00100073 ? "ebreak" : "ecall or CSR access";
+		return false;
+	default:
+		goto illegal;
+	}
+
+	if (rd)
+	{
+		cpu->x[rd] = value;
+	}
+	cpu->pc = next;
+	return true;
+
+illegal:
+	cpu->error = "illegal instruction";
+	return false;
+}
+
+static bool rv_step16(RvCpu *cpu, uint16_t insn)
+{
+	uint8_t funct3 = BITS(insn, 15, 13);
+	uint8_t rd = BITS(insn, 11, 7);		   // full register fields
+	uint8_t rs2 = BITS(insn, 6, 2);
+	uint8_t rdc = 8 + BITS(insn, 9, 7);	   // x8..x15 fields
+	uint8_t rs2c = 8 + BITS(insn, 4, 2);
+	int32_t imm6 = sign_extend(BITS(insn, 12, 12) << 5 | BITS(insn, 6, 2), 6);
+	uint32_t next = cpu->pc + 2;
+	uint32_t value;
+
+	if (insn == 0)
+	{
+		goto illegal;
+	}
+
+	switch (BITS(insn, 1, 0) << 3 | funct3)
+	{
+	case 000: // c.addi4spn
+	{
+		uint32_t imm = BITS(insn, 12, 11) << 4 | BITS(insn, 10, 7) << 6 |
+					   BITS(insn, 6, 6) << 2 | BITS(insn, 5, 5) << 3;
+		if (!imm)
+		{
+			goto illegal;
+		}
+		cpu->x[rs2c] = cpu->x[RV_SP] + imm;
+		break;
+	}
+	case 002: // c.lw
+	case 006: // c.sw
+	{
+		uint32_t addr = cpu->x[rdc] + (BITS(insn, 12, 10) << 3 | BITS(insn, 6, 6) << 2 | BITS(insn, 5, 5) << 6);
+		if (funct3 == 2 ? !rv_load(cpu, addr, 4, false, &cpu->x[rs2c]) : !rv_store(cpu, addr, 4, cpu->x[rs2c]))
+		{
+			return false;
+		}
+		break;
+	}
+	case 010: // c.addi, c.nop
+		if (!REG_OK(rd))
+		{
+			goto illegal;
+		}
+		if (rd)
+		{
+			cpu->x[rd] += imm6;
+		}
+		break;
+	case 011: // c.jal
+	case 015: // c.j
+	{
+		uint32_t offset = BITS(insn, 12, 12) << 11 | BITS(insn, 11, 11) << 4 | BITS(insn, 10, 9) << 8 |
+						  BITS(insn, 8, 8) << 10 | BITS(insn, 7, 7) << 6 | BITS(insn, 6, 6) << 7 |
+						  BITS(insn, 5, 3) << 1 | BITS(insn, 2, 2) << 5;
+		rv_jump(cpu, funct3 == 1 ? RV_RA : 0, cpu->pc + sign_extend(offset, 12), next);
+		return true;
+	}
+	case 012: // c.li
+		if (!REG_OK(rd))
+		{
+			goto illegal;
+		}
+		if (rd)
+		{
+			cpu->x[rd] = imm6;
+		}
+		break;
+	case 013: // c.addi16sp, c.lui
+		if (!REG_OK(rd) || imm6 == 0)
+		{
+			goto illegal;
+		}
+		if (rd == RV_SP)
+		{
+			uint32_t imm = BITS(insn, 12, 12) << 9 | BITS(insn, 6, 6) << 4 | BITS(insn, 5, 5) << 6 |
+						   BITS(insn, 4, 3) << 7 | BITS(insn, 2, 2) << 5;
+			cpu->x[RV_SP] += sign_extend(imm, 10);
+		}
+		else if (rd)
+		{
+			cpu->x[rd] = (uint32_t)imm6 << 12;
+		}
+		break;
+	case 014: // c.srli, c.srai, c.andi, c.sub, c.xor, c.or, c.and
+		switch (BITS(insn, 11, 10))
+		{
+		case 0:
+		case 1:
+			if (BITS(insn, 12, 12))
+			{
+				goto illegal;
+			}
+			cpu->x[rdc] = rv_alu(5, BITS(insn, 10, 10), cpu->x[rdc], rs2);
+			break;
+		case 2:
+			cpu->x[rdc] &= imm6;
+			break;
+		default:
+		{
+			static const uint8_t ops[4] = {0, 4, 6, 7};
+			if (BITS(insn, 12, 12))
+			{
+				goto illegal;
+			}
+			uint8_t op = BITS(insn, 6, 5);
+			cpu->x[rdc] = rv_alu(ops[op], op == 0, cpu->x[rdc], cpu->x[rs2c]);
+			break;
+		}
+		}
+		break;
+	case 016: // c.beqz
+	case 017: // c.bnez
+	{
+		uint32_t offset = BITS(insn, 12, 12) << 8 | BITS(insn, 11, 10) << 3 | BITS(insn, 6, 5) << 6 |
+						  BITS(insn, 4, 3) << 1 | BITS(insn, 2, 2) << 5;
+		bool zero = cpu->x[rdc] == 0;
+		cpu->pc = zero == (funct3 == 6) ? cpu->pc + sign_extend(offset, 9) : next;
+		return true;
+	}
+	case 020: // c.slli
+		if (!REG_OK(rd) || BITS(insn, 12, 12))
+		{
+			goto illegal;
+		}
+		if (rd)
+		{
+			cpu->x[rd] <<= rs2;
+		}
+		break;
+	case 022: // c.lwsp
+		if (!REG_OK(rd) || !rd)
+		{
+			goto illegal;
+		}
+		if (!rv_load(cpu, cpu->x[RV_SP] + (BITS(insn, 12, 12) << 5 | BITS(insn, 6, 4) << 2 | BITS(insn, 3, 2) << 6),
+					 4, false, &value))
+		{
+			return false;
+		}
+		cpu->x[rd] = value;
+		break;
+	case 024: // c.jr, c.mv, c.ebreak, c.jalr, c.add
+		if (!REG_OK(rd) || !REG_OK(rs2))
+		{
+			goto illegal;
+		}
+		if (!BITS(insn, 12, 12))
+		{
+			if (!rs2)
+			{
+				if (!rd)
+				{
+					goto illegal;
+				}
+				rv_jump(cpu, 0, cpu->x[rd] & ~1UL, next);
+				return true;
+			}
+			if (rd)
+			{
+				cpu->x[rd] = cpu->x[rs2];
+			}
+		}
+		else if (!rs2)
+		{
+			if (!rd)
+			{
+				cpu->error = "ebreak";
+				return false;
+			}
+			rv_jump(cpu, RV_RA, cpu->x[rd] & ~1UL, next);
+			return true;
+		}
+		else if (rd)
+		{
+			cpu->x[rd] += cpu->x[rs2];
+		}
+		break;
+	case 026: // c.swsp
+		if (!REG_OK(rs2))
+		{
+			goto illegal;
+		}
+		if (!rv_store(cpu, cpu->x[RV_SP] + (BITS(insn, 12, 9) << 2 | BITS(insn, 8, 7) << 6), 4, cpu->x[rs2]))
+		{
+			return false;
+		}
+		break;
+	default:
+		goto illegal;
+	}
+
+	cpu->pc = next;
+	return true;
+
+illegal:
+	cpu->error = "illegal instruction";
+	return false;
+}
+
+bool rv_call(RvCpu *cpu, uint32_t addr, uint32_t arg, uint32_t *ret)
+{
+	cpu->error = NULL;
+	cpu->pc = addr;
+	cpu->x[RV_RA] = RV_RETURN;
+	cpu->x[RV_SP] = (cpu->base + cpu->size) & ~15UL;
+	cpu->x[RV_A0] = arg;
+
+	for (uint32_t steps = 0; cpu->pc != RV_RETURN; steps++)
+	{
+		uint8_t *p = rv_addr(cpu, cpu->pc, 2);
+		if (steps >= RV_STEPS_MAX)
+		{
+			cpu->error = "too many steps";
+			return false;
+		}
+		if (!p || (cpu->pc & 1))
+		{
+			cpu->error = "fetch outside memory";
+			return false;
+		}
+
+		uint16_t low = p[0] | p[1] << 8;
+		bool ok;
+		if ((low & 3) == 3)
+		{
+			uint8_t *q = rv_addr(cpu, cpu->pc + 2, 2);
+			if (!q)
+			{
+				cpu->error = "fetch outside memory";
+				return false;
+			}
+			ok = rv_step32(cpu, low | (uint32_t)(q[0] | q[1] << 8) << 16);
+		}
+		else
+		{
+			ok = rv_step16(cpu, low);
+		}
+		if (!ok)
+		{
+			return false;
+		}
+		cpu->instret++;
+	}
+
+	*ret = cpu->x[RV_A0];
+	return true;
+}
@@ -0,0 +1,85 @@
+#ifndef RVSIM_H
+#define RVSIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Instruction counting simulator for the rv32ec core of the CH32V003, so
+ * target code can be costed on the host without the chip. It runs the
+ * RV32E base set and the C extension, nothing else: a multiply, a float
+ * or a CSR access is an illegal instruction, like on the chip. Memory is
+ * one flat block, there are no peripherals and no timing, only a count of
+ * retired instructions and of the calls that landed on each known
+ * function, which is where the libgcc soft-float and divide routines show.
+ */
+#define RV_FUNCS_MAX 512
+#define RV_NAME_LEN 32
+#define RV_STACK_SIZE 4096		// added above the image by rv_load_elf()
+#define RV_STEPS_MAX 10000000UL // a call that runs longer has gone wrong
+
+typedef struct
+{
+	char name[RV_NAME_LEN];
+	uint32_t addr;
+	uint32_t calls; // jal/jalr with the link in ra that landed here
+} RvFunc;
+
+typedef struct
+{
+	uint32_t x[16];
+	uint32_t pc;
+	uint8_t *mem;
+	uint32_t base; // address of mem[0]
+	uint32_t size;
+	uint64_t instret; // instructions retired, never reset by a call
+	RvFunc funcs[RV_FUNCS_MAX];
+	uint16_t func_count;
+	const char *error; // why the last call stopped, NULL if it returned
+} RvCpu;
+
+/**
+ * @brief Sets up size bytes of zeroed memory at base, sp at the top.
+ * @return false if out of memory.
+ */
+bool rv_init(RvCpu *cpu, uint32_t base, uint32_t size);
+
+/**
+ * @brief Frees the memory.
+ */
+void rv_free(RvCpu *cpu);
+
+/**
+ * @brief Loads a linked RISC-V ELF: every PT_LOAD segment, the function
+ * symbols, and gp from __global_pointer$ when there is one. Calls
+ * rv_init() itself with RV_STACK_SIZE above the highest segment.
+ * @return false with error set if the file is not a 32 bit RISC-V image.
+ */
+bool rv_load_elf(RvCpu *cpu, const char *path);
+
+/**
+ * @brief Copies len bytes into memory at addr.
+ * @return false if they do not fit.
+ */
+bool rv_write(RvCpu *cpu, uint32_t addr, const void *data, uint32_t len);
+
+/**
+ * @brief Names a function so calls to it are counted.
+ */
+bool rv_add_func(RvCpu *cpu, const char *name, uint32_t addr);
+
+/**
+ * @brief Looks a function up by name, NULL if it is not known.
+ */
+RvFunc *rv_find(RvCpu *cpu, const char *name);
+
+/**
+ * @brief Calls the function at addr with a0 = arg and runs it until it
+ * returns, at most RV_STEPS_MAX instructions.
+ * @param ret Set to a0 on return.
+ * @return false with error set on an illegal instruction, a bad access,
+ * ecall/ebreak or too many steps.
+ */
+bool rv_call(RvCpu *cpu, uint32_t addr, uint32_t arg, uint32_t *ret);
+
+#endif
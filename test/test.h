@@ -0,0 +1,41 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+/*
+ * Minimal checks for the host tests. A failed check prints where it failed
+ * and the test carries on, test_done() turns the failures into the exit
+ * status make looks at.
+ */
+static int test_failures;
+
+#define CHECK(cond)                                                      \
+	do                                                                   \
+	{                                                                    \
+		if (!(cond))                                                     \
+		{                                                                \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			test_failures++;                                             \
+		}                                                                \
+	} while (0)
+
+#define CHECK_EQ(a, b)                                                            \
+	do                                                                            \
+	{                                                                             \
+		long long check_a = (a), check_b = (b);                                   \
+		if (check_a != check_b)                                                   \
+		{                                                                         \
+			printf("%s:%d: %s == %s failed, %lld != %lld\n", __FILE__, __LINE__, \
+				   #a, #b, check_a, check_b);                                     \
+			test_failures++;                                                      \
+		}                                                                         \
+	} while (0)
+
+static inline int test_done(const char *name)
+{
+	printf("%s: %s\n", name, test_failures ? "FAILED" : "ok");
+	return test_failures != 0;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include "test.h"
+#include "plant.h"
+#include "autotune.h"
+
+#define DUTY_MAX 1024 // FAN_DUTY_MAX
+
+// Period and peak to peak swing of the relay oscillation, from a long run
+// of the same relay in doubles, cycles 10..29
+static void reference(double setpoint, double *period_s, double *swing)
+{
+	Plant plant;
+	bool high = false;
+	uint32_t rises = 0, first_rise = 0, last_rise = 0;
+	double hi = -1e9, lo = 1e9, swing_sum = 0;
+
+	plant_init(&plant, setpoint + 5);
+	for (uint32_t t = 0; rises < 30; t++)
+	{
+		double seen = plant_read(&plant) / 4.0;
+		hi = fmax(hi, seen);
+		lo = fmin(lo, seen);
+		if (!high && seen > setpoint + AUTOTUNE_HYSTERESIS / 4.0)
+		{
+			high = true;
+			if (rises == 10)
+			{
+				first_rise = t;
+			}
+			if (rises > 10)
+			{
+				swing_sum += hi - lo;
+			}
+			last_rise = t;
+			rises++;
+			hi = lo = seen;
+		}
+		else if (high && seen < setpoint - AUTOTUNE_HYSTERESIS / 4.0)
+		{
+			high = false;
+		}
+		plant_step(&plant, high ? 1 : 0);
+	}
+	*period_s = (double)(last_rise - first_rise) / (rises - 11);
+	*swing = swing_sum / (rises - 11);
+}
+
+static void test_tune(void)
+{
+	Plant plant;
+	AutoTune tune;
+	PidConfig config = {0, 0, 0, 205, DUTY_MAX};
+	uint32_t t = 0;
+
+	plant_init(&plant, 45);
+	autotune_start(&tune, TEMP_Q2(40), DUTY_MAX, 0);
+	while (tune.state == AUTOTUNE_RUNNING)
+	{
+		uint16_t out = autotune_update(&tune, plant_read(&plant), t * 1000);
+		CHECK(out == 0 || out == DUTY_MAX);
+		plant_step(&plant, (double)out / DUTY_MAX);
+		t++;
+	}
+	CHECK_EQ(tune.state, AUTOTUNE_DONE);
+	CHECK(autotune_gains(&tune, &config));
+
+	double period, swing;
+	reference(40, &period, &swing);
+	double tuned_period = tune.period_sum / 1000.0 / AUTOTUNE_CYCLES;
+	double tuned_swing = tune.swing_sum / 4.0 / AUTOTUNE_CYCLES;
+	printf("autotune: done in %us, Tu %.0fs (steady %.0fs), swing %.2fC (steady %.2fC), P%u I%u D%u (kp %u kd %u)\n",
+		   t, tuned_period, period, tuned_swing, swing, config.kp, config.ki, config.kd,
+		   config.kp << PID_KP_SHIFT, config.kd << PID_KD_SHIFT);
+	CHECK(t < AUTOTUNE_TIMEOUT_MS / 1000);
+	CHECK(fabs(tuned_period - period) < period * 0.1);
+	CHECK(fabs(tuned_swing - swing) < swing * 0.1 + 0.25);
+	CHECK(config.kp > 0 && config.ki > 0);
+	// None pinned at the top of its byte, that is a clamped gain
+	CHECK(config.kp < UINT8_MAX && config.ki < UINT8_MAX && config.kd < UINT8_MAX);
+
+	// The tuned loop holds the setpoint on the same plant
+	PidState pid;
+	double lo = 1e9, hi = -1e9;
+	pid_reset(&pid);
+	for (uint32_t s = 0; s < 7200; s++)
+	{
+		uint16_t out = pid_update(&pid, &config, TEMP_Q2(40), plant_read(&plant));
+		plant_step(&plant, (double)out / DUTY_MAX);
+		if (s >= 3600)
+		{
+			lo = fmin(lo, plant.temp);
+			hi = fmax(hi, plant.temp);
+		}
+	}
+	printf("autotune: tuned loop holds %.2f..%.2fC in the second hour\n", lo, hi);
+	CHECK(hi - 40 < 0.75 && 40 - lo < 0.75);
+}
+
+static void test_abort_and_timeout(void)
+{
+	AutoTune tune;
+
+	autotune_start(&tune, TEMP_Q2(40), DUTY_MAX, 0);
+	autotune_abort(&tune);
+	CHECK_EQ(tune.state, AUTOTUNE_FAILED);
+	CHECK_EQ(autotune_update(&tune, TEMP_Q2(50), 1000), 0);
+
+	// Never crosses the setpoint, gives up at the timeout. Start near the
+	// top of millis() so the timeout is checked across the wrap
+	uint32_t start = UINT32_MAX - 1000;
+	autotune_start(&tune, TEMP_Q2(40), DUTY_MAX, start);
+	CHECK_EQ(autotune_update(&tune, TEMP_Q2(30), start + AUTOTUNE_TIMEOUT_MS), 0);
+	CHECK_EQ(tune.state, AUTOTUNE_RUNNING);
+	autotune_update(&tune, TEMP_Q2(30), start + AUTOTUNE_TIMEOUT_MS + 1);
+	CHECK_EQ(tune.state, AUTOTUNE_FAILED);
+}
+
+static void test_gain_range(void)
+{
+	AutoTune tune;
+	PidConfig config = {1, 2, 3, 205, DUTY_MAX};
+
+	// A quarter degree swing at full relay output needs gains no byte
+	// holds: the tune fails and config is left alone
+	autotune_start(&tune, TEMP_Q2(40), DUTY_MAX, 0);
+	tune.state = AUTOTUNE_DONE;
+	tune.swing_sum = AUTOTUNE_CYCLES;
+	tune.period_sum = AUTOTUNE_CYCLES * 600000UL;
+	CHECK(!autotune_gains(&tune, &config));
+	CHECK_EQ(tune.state, AUTOTUNE_FAILED);
+	CHECK_EQ(config.kp, 1);
+	CHECK_EQ(config.ki, 2);
+	CHECK_EQ(config.kd, 3);
+}
+
+int main(void)
+{
+	test_tune();
+	test_abort_and_timeout();
+	test_gain_range();
+	return test_done("autotune");
+}
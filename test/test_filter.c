@@ -0,0 +1,96 @@
+#include "test.h"
+#include "filter.h"
+
+// A MAX6675 log at ~4.5 samples/s: noise of a step either way around
+// 25C, a single sample glitch, then a step to ~30C when a heat source
+// comes on
+static const temp_q2_t trace[] = {
+	100, 101, 100, 99, 100, 100, 101, 100, 99, 100,
+	100, 101, 160, 100, 99, 100, 101, 100, 100, 99,
+	100, 120, 120, 121, 120, 119, 120, 120, 121, 120,
+	120, 119, 120, 120, 121, 120, 120, 120, 119, 120,
+};
+
+static void test_converges(void)
+{
+	// A constant input comes out exactly, from either side and at any
+	// coefficient
+	static const temp_q2_t starts[] = {TEMP_Q2(20), TEMP_Q2(-10), TEMP_Q2(80)};
+	static const temp_q2_t targets[] = {TEMP_Q2(25) + 1, TEMP_Q2(-5) - 3, TEMP_Q2(60) + 2};
+
+	for (uint8_t shift = 0; shift <= FILTER_SHIFT_MAX; shift++)
+	{
+		for (uint8_t i = 0; i < 3; i++)
+		{
+			for (uint8_t j = 0; j < 3; j++)
+			{
+				TempFilter filter;
+				temp_q2_t out = 0;
+
+				filter_reset(&filter);
+				filter_update(&filter, starts[i], shift);
+				for (uint16_t n = 0; n < 2000; n++)
+				{
+					out = filter_update(&filter, targets[j], shift);
+				}
+				CHECK_EQ(out, targets[j]);
+			}
+		}
+	}
+}
+
+static void test_trace(void)
+{
+	TempFilter filter;
+	temp_q2_t out[sizeof(trace) / sizeof(trace[0])];
+
+	filter_reset(&filter);
+	for (uint8_t i = 0; i < sizeof(trace) / sizeof(trace[0]); i++)
+	{
+		out[i] = filter_update(&filter, trace[i], 2);
+	}
+
+	// The first sample passes straight through
+	CHECK_EQ(out[0], 100);
+	// The glitch at 12 never shows, the noise stays inside its band
+	for (uint8_t i = 0; i < 21; i++)
+	{
+		CHECK(out[i] >= 99 && out[i] <= 101);
+	}
+	// The step comes through once it is confirmed by a second sample,
+	// rises without overshoot and settles at full resolution
+	CHECK(out[21] <= 101);
+	for (uint8_t i = 22; i < 40; i++)
+	{
+		CHECK(out[i] >= out[i - 1] - 1 && out[i] <= 121);
+	}
+	CHECK(out[39] >= 119 && out[39] <= 121);
+}
+
+static void test_median_only(void)
+{
+	TempFilter filter;
+
+	// Shift 0 is the median alone: single spikes go, steps pass after two
+	filter_reset(&filter);
+	filter_update(&filter, 100, 0);
+	filter_update(&filter, 100, 0);
+	CHECK_EQ(filter_update(&filter, 100, 0), 100);
+	CHECK_EQ(filter_update(&filter, 300, 0), 100);
+	CHECK_EQ(filter_update(&filter, 100, 0), 100);
+	CHECK_EQ(filter_update(&filter, -50, 0), 100);
+	CHECK_EQ(filter_update(&filter, 200, 0), 100);
+	CHECK_EQ(filter_update(&filter, 200, 0), 200);
+
+	// A reset forgets the window
+	filter_reset(&filter);
+	CHECK_EQ(filter_update(&filter, 50, 0), 50);
+}
+
+int main(void)
+{
+	test_converges();
+	test_trace();
+	test_median_only();
+	return test_done("filter");
+}
@@ -0,0 +1,59 @@
+#include "test.h"
+#include "format.h"
+#include <string.h>
+
+#define CHECK_STR(expr, expected)                                           \
+	do                                                                      \
+	{                                                                       \
+		char *check_end = (expr);                                           \
+		if (strcmp(buf, expected) != 0 || check_end != buf + strlen(buf))   \
+		{                                                                   \
+			printf("%s:%d: %s gave \"%s\", expected \"%s\"\n", __FILE__, __LINE__, \
+				   #expr, buf, expected);                                   \
+			test_failures++;                                                \
+		}                                                                   \
+	} while (0)
+
+static char buf[32];
+
+static void test_ints(void)
+{
+	CHECK_STR(fmt_uint(buf, 0, 0, ' '), "0");
+	CHECK_STR(fmt_uint(buf, 7, 3, ' '), "  7");
+	CHECK_STR(fmt_uint(buf, 7, 3, '0'), "007");
+	CHECK_STR(fmt_uint(buf, 1000, 3, ' '), "1000");
+	CHECK_STR(fmt_uint(buf, UINT16_MAX, 0, ' '), "65535");
+
+	CHECK_STR(fmt_int(buf, -5, 4, ' '), "  -5");
+	CHECK_STR(fmt_int(buf, -5, 4, '0'), "-005");
+	CHECK_STR(fmt_int(buf, INT16_MAX, 0, ' '), "32767");
+	CHECK_STR(fmt_int(buf, INT16_MIN, 0, ' '), "-32768");
+	CHECK_STR(fmt_int(buf, INT16_MIN, 8, '0'), "-0032768");
+
+	char *p = fmt_str(buf, "T1:");
+	p = fmt_int(p, -12, 0, ' ');
+	CHECK_STR(fmt_pad(buf, p, 8), "T1:-12  ");
+}
+
+static void test_temps(void)
+{
+	CHECK_STR(fmt_temp(buf, TEMP_Q2(25) + 1, true, 0), "25.25");
+	CHECK_STR(fmt_temp(buf, TEMP_Q2(25) + 3, false, 0), "26");
+	CHECK_STR(fmt_temp(buf, -1, true, 7), "  -0.25");
+	CHECK_STR(fmt_temp(buf, TEMP_Q2(-10) - 2, true, 0), "-10.50");
+	CHECK_STR(fmt_temp(buf, TEMP_Q2(-10) - 2, false, 4), " -10");
+
+	// The ends of the range stay inside TEMP_STR_LEN
+	CHECK_STR(fmt_temp(buf, INT16_MAX, true, 0), "8191.75");
+	CHECK_STR(fmt_temp(buf, -INT16_MAX, true, 0), "-8191.75");
+	CHECK_STR(fmt_temp(buf, INT16_MIN, true, 0), "-8191.75");
+	CHECK(strlen(buf) < TEMP_STR_LEN);
+	CHECK_STR(fmt_temp(buf, INT16_MIN, false, 0), "-8192");
+}
+
+int main(void)
+{
+	test_ints();
+	test_temps();
+	return test_done("format");
+}
@@ -0,0 +1,161 @@
+#include "test.h"
+#include "input.h"
+#include <pthread.h>
+#include <sched.h>
+
+static void test_full_queue(void)
+{
+	InputQueue queue = {0};
+	InputEvent event;
+
+	CHECK(!input_get(&queue, &event));
+	for (uint32_t i = 0; i < INPUT_QUEUE_LEN; i++)
+	{
+		CHECK(input_put(&queue, INPUT_ENCODER, 1, -(int16_t)i, i));
+		CHECK_EQ(input_count(&queue), i + 1);
+	}
+
+	// A full queue drops the new event and keeps the old ones
+	CHECK(!input_put(&queue, INPUT_BUTTON, 2, 0, 99));
+	CHECK(!input_put(&queue, INPUT_BUTTON, 2, 0, 99));
+	CHECK_EQ(queue.overflows, 2);
+	CHECK_EQ(input_count(&queue), INPUT_QUEUE_LEN);
+
+	for (uint32_t i = 0; i < INPUT_QUEUE_LEN; i++)
+	{
+		CHECK(input_get(&queue, &event));
+		CHECK_EQ(event.type, INPUT_ENCODER);
+		CHECK_EQ(event.code, 1);
+		CHECK_EQ(event.value, -(int16_t)i);
+		CHECK_EQ(event.time, i);
+	}
+	CHECK(!input_get(&queue, &event));
+	CHECK_EQ(input_count(&queue), 0);
+
+	// The drop counter saturates
+	queue.overflows = UINT16_MAX - 1;
+	for (uint32_t i = 0; i < INPUT_QUEUE_LEN + 3; i++)
+	{
+		input_put(&queue, INPUT_EDGE, 1, 0, i);
+	}
+	CHECK_EQ(queue.overflows, UINT16_MAX);
+}
+
+static void test_wrap(void)
+{
+	// head and tail count freely through the uint8_t wrap, with the
+	// queue at every fill level on the way
+	InputQueue queue = {0};
+	InputEvent event;
+	uint32_t put = 0, got = 0;
+
+	for (uint32_t round = 0; round < 1000; round++)
+	{
+		uint32_t n = round % (INPUT_QUEUE_LEN + 1);
+		for (uint32_t i = 0; i < n; i++)
+		{
+			CHECK(input_put(&queue, INPUT_EDGE, 0, 0, put++));
+		}
+		CHECK_EQ(input_count(&queue), n);
+		while (input_get(&queue, &event))
+		{
+			CHECK_EQ(event.time, got++);
+		}
+	}
+	CHECK_EQ(got, put);
+	CHECK_EQ(queue.overflows, 0);
+}
+
+// Producer and consumer on two threads. A producer that waits for room
+// must never lose an event. One that does not, like an interrupt, may only
+// lose what it counted in overflows
+typedef struct
+{
+	InputQueue queue;
+	uint32_t events;
+	int wait;
+	int done;
+	uint32_t refused; // puts that failed with room in the queue
+} Stress;
+
+static void *stress_producer(void *arg)
+{
+	Stress *stress = arg;
+
+	for (uint32_t i = 0; i < stress->events; i++)
+	{
+		if (stress->wait)
+		{
+			while (input_count(&stress->queue) >= INPUT_QUEUE_LEN)
+			{
+				sched_yield();
+			}
+			if (!input_put(&stress->queue, INPUT_ENCODER, i & 7, (int16_t)i, i))
+			{
+				stress->refused++;
+			}
+		}
+		else
+		{
+			input_put(&stress->queue, INPUT_ENCODER, i & 7, (int16_t)i, i);
+		}
+	}
+	__atomic_store_n(&stress->done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void test_stress(int wait, uint32_t events)
+{
+	static Stress stress;
+	pthread_t thread;
+	InputEvent event;
+	uint32_t got = 0, next = 0, bad = 0;
+
+	stress = (Stress){.events = events, .wait = wait};
+	CHECK_EQ(pthread_create(&thread, NULL, stress_producer, &stress), 0);
+
+	for (;;)
+	{
+		// Read before the get: once the producer is done, an empty queue
+		// stays empty
+		int done = __atomic_load_n(&stress.done, __ATOMIC_ACQUIRE);
+
+		if (!input_get(&stress.queue, &event))
+		{
+			if (done)
+			{
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+
+		// Strictly in order, and the slot was filled before it was published
+		if (event.time < next || event.type != INPUT_ENCODER ||
+			event.code != (event.time & 7) || event.value != (int16_t)event.time)
+		{
+			bad++;
+		}
+		next = event.time + 1;
+		got++;
+	}
+	pthread_join(thread, NULL);
+
+	CHECK_EQ(bad, 0);
+	CHECK_EQ(stress.refused, 0);
+	CHECK_EQ(got + stress.queue.overflows, events);
+	if (wait)
+	{
+		CHECK_EQ(got, events);
+	}
+}
+
+int main(void)
+{
+	test_full_queue();
+	test_wrap();
+	test_stress(1, 2000000);
+	// Few enough that the drop counter cannot saturate
+	test_stress(0, 60000);
+	return test_done("input");
+}
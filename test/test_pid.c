@@ -0,0 +1,131 @@
+#include "test.h"
+#include "plant.h"
+#include "pid.h"
+
+#define DUTY_MAX 1024 // FAN_DUTY_MAX
+
+// The defaults from settings.c: kp 24, ki 2, kd 0, duty 20..100%
+static const PidConfig defaults = {24, 2, 0, 205, DUTY_MAX};
+
+typedef struct
+{
+	double peak;	   // highest temperature after first reaching the setpoint
+	double low;		   // lowest
+	uint32_t settle_s; // last time outside +-0.5C of the setpoint
+	double final;	   // temperature at the end
+} SimResult;
+
+// Runs the loop once a second, as fanTask does, for seconds
+static SimResult simulate(const PidConfig *config, double start, double setpoint, uint32_t seconds)
+{
+	Plant plant;
+	PidState pid;
+	SimResult result = {start, start, 0, start};
+	bool reached = false;
+
+	plant_init(&plant, start);
+	pid_reset(&pid);
+	for (uint32_t t = 0; t < seconds; t++)
+	{
+		uint16_t out = pid_update(&pid, config, TEMP_Q2(setpoint), plant_read(&plant));
+		CHECK(out == 0 || (out >= config->out_min && out <= config->out_max));
+		plant_step(&plant, (double)out / DUTY_MAX);
+
+		if (!reached && plant.temp <= setpoint)
+		{
+			reached = true;
+			result.peak = result.low = plant.temp;
+		}
+		if (reached)
+		{
+			result.peak = fmax(result.peak, plant.temp);
+			result.low = fmin(result.low, plant.temp);
+		}
+		if (fabs(plant.temp - setpoint) > 0.5)
+		{
+			result.settle_s = t;
+		}
+	}
+	result.final = plant.temp;
+	return result;
+}
+
+static void test_settle(void)
+{
+	// Cooling down from 60C to a 40C setpoint, which needs ~75% duty
+	SimResult r = simulate(&defaults, 60, 40, 3600);
+	printf("pid: 60C -> 40C settles in %us, range %.2f..%.2fC after reaching it\n",
+		   r.settle_s, r.low, r.peak);
+	CHECK(fabs(r.final - 40) < 0.5);
+	CHECK(r.settle_s < 1800);
+	CHECK(r.peak - 40 < 1.5);
+	CHECK(40 - r.low < 1.5);
+}
+
+static void test_off_when_cold(void)
+{
+	Plant plant;
+	PidState pid;
+
+	plant_init(&plant, 30);
+	pid_reset(&pid);
+	for (uint8_t t = 0; t < 60; t++)
+	{
+		CHECK_EQ(pid_update(&pid, &defaults, TEMP_Q2(40), plant_read(&plant)), 0);
+		plant_step(&plant, 0);
+	}
+}
+
+static void test_windup(void)
+{
+	Plant plant;
+	PidState pid;
+
+	// 30C is below what full cooling reaches (37C), so the output stays
+	// pinned for an hour
+	plant_init(&plant, 60);
+	pid_reset(&pid);
+	for (uint32_t t = 0; t < 3600; t++)
+	{
+		plant_step(&plant, (double)pid_update(&pid, &defaults, TEMP_Q2(30), plant_read(&plant)) / DUTY_MAX);
+	}
+	CHECK(pid.integral <= (int32_t)defaults.out_max << PID_SHIFT);
+
+	// Raise the setpoint above the temperature: without windup the output
+	// leaves full duty as soon as the error turns
+	uint32_t t = 0;
+	while (pid_update(&pid, &defaults, TEMP_Q2(45), plant_read(&plant)) == DUTY_MAX && t < 3600)
+	{
+		plant_step(&plant, 1);
+		t++;
+	}
+	printf("pid: leaves full duty %us after an unreachable setpoint is raised\n", t);
+	CHECK(t < 30);
+}
+
+static void test_derivative_on_measurement(void)
+{
+	PidState with_d, without_d;
+	PidConfig config = defaults;
+
+	// With the measurement steady, setpoint steps must not kick the output
+	// through the derivative, it should match a loop without one
+	config.kd = 100;
+	pid_reset(&with_d);
+	pid_reset(&without_d);
+	static const uint8_t setpoints[] = {40, 40, 35, 35, 42, 42, 38};
+	for (uint8_t i = 0; i < sizeof(setpoints); i++)
+	{
+		CHECK_EQ(pid_update(&with_d, &config, TEMP_Q2(setpoints[i]), TEMP_Q2(41)),
+				 pid_update(&without_d, &defaults, TEMP_Q2(setpoints[i]), TEMP_Q2(41)));
+	}
+}
+
+int main(void)
+{
+	test_settle();
+	test_off_when_cold();
+	test_windup();
+	test_derivative_on_measurement();
+	return test_done("pid");
+}
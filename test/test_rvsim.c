@@ -0,0 +1,268 @@
+#include "test.h"
+#include "rvsim.h"
+#include <string.h>
+
+// The programs are rv32ec machine code, assembled with llvm-mc
+// -mattr=+e,+c,-relax. The source is in the comments
+#define BASE 0x10000UL
+#define BUF (BASE + 0x800) // results, written by the programs
+#define SIZE 0x1000UL
+
+// entry: sum of 1..a0, doubled by a c.jal to twice
+//	addi sp, sp, -16; sw ra, 12(sp); sw s0, 8(sp); mv s0, a0; li a1, 0; li a2, 1
+// loop: add a1, a1, a2; addi a2, a2, 1; bge s0, a2, loop
+//	mv a0, a1; jal twice; lw s0, 8(sp); lw ra, 12(sp); addi sp, sp, 16; ret
+// twice (0x20): slli a0, a0, 1; ret
+static const uint8_t sum_code[] = {
+	0x41, 0x11, 0x06, 0xc6, 0x22, 0xc4, 0x2a, 0x84, 0x81, 0x45, 0x05, 0x46,
+	0xb2, 0x95, 0x05, 0x06, 0xe3, 0x5e, 0xc4, 0xfe, 0x2e, 0x85, 0x29, 0x20,
+	0x22, 0x44, 0xb2, 0x40, 0x41, 0x01, 0x82, 0x80, 0x06, 0x05, 0x82, 0x80,
+};
+#define SUM_TWICE 0x20
+
+// Every 32 bit RV32I form, results stored at a0. With t0 = -8, t1 = 3:
+//	srai 1, srli 28, sll, sra, srl, slt, sltu, sub t1 - t0, xori -1,
+//	sltiu t1 < 4, slti t0 < -9, lui 0xfffff + ori 0x7ff, andi 0x7c,
+//	sh -2 then lh and lhu, sb t0 then lb and lbu, then a bit for each
+//	branch that falls through: blt 1, bltu 2, bge 4, bgeu 8, beq t1 t1 16,
+//	bne t1 t1 32. auipc + jal a1 link distance, auipc + jalr a2, 12 link
+//	distance, whether jalr skipped "li a3, 1", and slt t1 t1, slti t1 3,
+//	sltu t1 t1
+static const uint8_t base_code[] = {
+	0x93, 0x02, 0x80, 0xff, 0x13, 0x03, 0x30, 0x00, 0x93, 0xd3, 0x12, 0x40,
+	0x23, 0x20, 0x75, 0x00, 0x93, 0xd3, 0xc2, 0x01, 0x23, 0x22, 0x75, 0x00,
+	0xb3, 0x13, 0x63, 0x00, 0x23, 0x24, 0x75, 0x00, 0xb3, 0xd3, 0x62, 0x40,
+	0x23, 0x26, 0x75, 0x00, 0xb3, 0xd3, 0x62, 0x00, 0x23, 0x28, 0x75, 0x00,
+	0xb3, 0xa3, 0x62, 0x00, 0x23, 0x2a, 0x75, 0x00, 0xb3, 0xb3, 0x62, 0x00,
+	0x23, 0x2c, 0x75, 0x00, 0xb3, 0x03, 0x53, 0x40, 0x23, 0x2e, 0x75, 0x00,
+	0x93, 0xc3, 0xf2, 0xff, 0x23, 0x20, 0x75, 0x02, 0x93, 0x33, 0x43, 0x00,
+	0x23, 0x22, 0x75, 0x02, 0x93, 0xa3, 0x72, 0xff, 0x23, 0x24, 0x75, 0x02,
+	0xb7, 0xf3, 0xff, 0xff, 0x93, 0xe3, 0xf3, 0x7f, 0x23, 0x26, 0x75, 0x02,
+	0x93, 0xf3, 0xc2, 0x07, 0x23, 0x28, 0x75, 0x02, 0x13, 0x03, 0xe0, 0xff,
+	0x23, 0x10, 0x65, 0x08, 0x83, 0x13, 0x05, 0x08, 0x23, 0x2a, 0x75, 0x02,
+	0x83, 0x53, 0x05, 0x08, 0x23, 0x2c, 0x75, 0x02, 0x23, 0x02, 0x55, 0x08,
+	0x83, 0x03, 0x45, 0x08, 0x23, 0x2e, 0x75, 0x02, 0x83, 0x43, 0x45, 0x08,
+	0x23, 0x20, 0x75, 0x04, 0x13, 0x03, 0x30, 0x00, 0x93, 0x05, 0x00, 0x00,
+	0x63, 0xc4, 0x62, 0x00, 0x93, 0xe5, 0x15, 0x00, 0x63, 0xe4, 0x62, 0x00,
+	0x93, 0xe5, 0x25, 0x00, 0x63, 0xd4, 0x62, 0x00, 0x93, 0xe5, 0x45, 0x00,
+	0x63, 0xf4, 0x62, 0x00, 0x93, 0xe5, 0x85, 0x00, 0x63, 0x04, 0x63, 0x00,
+	0x93, 0xe5, 0x05, 0x01, 0x63, 0x14, 0x63, 0x00, 0x93, 0xe5, 0x05, 0x02,
+	0x23, 0x22, 0xb5, 0x04, 0x97, 0x03, 0x00, 0x00, 0xef, 0x05, 0x40, 0x00,
+	0xb3, 0x85, 0x75, 0x40, 0x23, 0x24, 0xb5, 0x04, 0x93, 0x06, 0x00, 0x00,
+	0x97, 0x03, 0x00, 0x00, 0x67, 0x86, 0xc3, 0x00, 0x93, 0x06, 0x10, 0x00,
+	0x33, 0x06, 0x76, 0x40, 0x23, 0x26, 0xc5, 0x04, 0x23, 0x28, 0xd5, 0x04,
+	0xb3, 0x23, 0x63, 0x00, 0x23, 0x2a, 0x75, 0x04, 0x93, 0x23, 0x33, 0x00,
+	0x23, 0x2c, 0x75, 0x04, 0xb3, 0x33, 0x63, 0x00, 0x23, 0x2e, 0x75, 0x04,
+	0x67, 0x80, 0x00, 0x00,
+};
+static const uint32_t base_results[] = {
+	0xfffffffc, 0xf, 24, 0xffffffff, 0x1fffffff, 1, 0, 11, 7, 1, 0,
+	0xfffff7ff, 0x78, 0xfffffffe, 0xfffe, 0xfffffff8, 0xf8, 2 | 4 | 32, 8, 8, 0,
+	0, 0, 0,
+};
+
+// The compressed forms, results stored at a0. With a1 = -8, a2 = 3:
+//	c.srai 1, c.srli 28, c.andi 28, c.sub a2 - a1, c.xor, c.or, c.and,
+//	c.lui 0xfffe0 and c.sw, that word back through c.lw, c.addi4spn 16
+//	less sp, a bit for each of c.beqz 1, c.bnez 2, c.j 4 that falls
+//	through, then s0 from a c.jalr to sub (li s0, 30; ret) plus 12, and
+//	that plus a2 by c.add, and how far c.addi16sp -208 and 208
+//	moved sp
+static const uint8_t compressed_code[] = {
+	0xaa, 0x87, 0xe1, 0x55, 0x0d, 0x46, 0xae, 0x86, 0x85, 0x86, 0x94, 0xc3,
+	0xae, 0x86, 0xf1, 0x82, 0xd4, 0xc3, 0xae, 0x86, 0xf1, 0x8a, 0x94, 0xc7,
+	0xb2, 0x86, 0x8d, 0x8e, 0xd4, 0xc7, 0xae, 0x86, 0xb1, 0x8e, 0x94, 0xcb,
+	0xae, 0x86, 0xd1, 0x8e, 0xd4, 0xcb, 0xae, 0x86, 0xf1, 0x8e, 0x94, 0xcf,
+	0x81, 0x76, 0xd4, 0xcf, 0xd8, 0x4f, 0x98, 0xd3, 0x18, 0x08, 0x33, 0x07,
+	0x27, 0x40, 0xd8, 0xd3, 0x01, 0x47, 0x11, 0xc2, 0x05, 0x07, 0x11, 0xe2,
+	0x09, 0x07, 0x11, 0xa0, 0x11, 0x07, 0x98, 0xd7, 0x86, 0x84, 0x97, 0x06,
+	0x00, 0x00, 0xb1, 0x06, 0x82, 0x96, 0x21, 0xa0, 0x01, 0x00, 0x79, 0x44,
+	0x82, 0x80, 0x31, 0x04, 0xc0, 0xd7, 0x32, 0x94, 0x80, 0xdb, 0x0a, 0x87,
+	0x55, 0x71, 0x33, 0x07, 0x27, 0x40, 0xd8, 0xdb, 0x0a, 0x87, 0x69, 0x61,
+	0x33, 0x07, 0xe1, 0x40, 0x98, 0xdf, 0xa6, 0x80, 0x82, 0x80,
+};
+static const uint32_t compressed_results[] = {
+	0xfffffffc, 0xf, 24, 11, 0xfffffffb, 0xfffffffb, 0,
+	0xfffe0000, 0xfffe0000, 16, 1, 42, 45, 208, 208,
+};
+#define COMPRESSED_SUB 0x5e
+
+static RvCpu cpu;
+
+static void load(const uint8_t *code, uint32_t len)
+{
+	CHECK(rv_init(&cpu, BASE, SIZE));
+	CHECK(rv_write(&cpu, BASE, code, len));
+}
+
+static void check_results(const uint32_t *expected, uint8_t count)
+{
+	for (uint8_t i = 0; i < count; i++)
+	{
+		uint32_t value = 0;
+		memcpy(&value, cpu.mem + (BUF - BASE) + 4 * i, 4);
+		if (value != expected[i])
+		{
+			printf("result %u: %08x != %08x\n", i, value, expected[i]);
+			test_failures++;
+		}
+	}
+}
+
+static void test_sum(void)
+{
+	uint32_t ret = 0;
+
+	load(sum_code, sizeof(sum_code));
+	CHECK(rv_add_func(&cpu, "twice", BASE + SUM_TWICE));
+	CHECK(rv_call(&cpu, BASE, 10, &ret));
+	CHECK_EQ(ret, 110);
+
+	// 6 of prologue, 3 a turn of the loop, 8 to double and return
+	CHECK_EQ(cpu.instret, 6 + 3 * 10 + 8);
+	CHECK_EQ(rv_find(&cpu, "twice")->calls, 1);
+	CHECK(rv_find(&cpu, "entry") == NULL);
+
+	// Counts carry on across calls, sp starts at the top again
+	CHECK(rv_call(&cpu, BASE, 1, &ret));
+	CHECK_EQ(ret, 2);
+	CHECK_EQ(cpu.instret, 44 + 6 + 3 + 8);
+	CHECK_EQ(rv_find(&cpu, "twice")->calls, 2);
+	rv_free(&cpu);
+}
+
+static void test_base(void)
+{
+	uint32_t ret = 0;
+
+	load(base_code, sizeof(base_code));
+	CHECK(rv_call(&cpu, BASE, BUF, &ret));
+	CHECK(cpu.error == NULL);
+	check_results(base_results, sizeof(base_results) / sizeof(base_results[0]));
+	rv_free(&cpu);
+}
+
+static void test_compressed(void)
+{
+	uint32_t ret = 0;
+
+	load(compressed_code, sizeof(compressed_code));
+	CHECK(rv_add_func(&cpu, "sub", BASE + COMPRESSED_SUB));
+	CHECK(rv_call(&cpu, BASE, BUF, &ret));
+	CHECK(cpu.error == NULL);
+	check_results(compressed_results, sizeof(compressed_results) / sizeof(compressed_results[0]));
+	CHECK_EQ(rv_find(&cpu, "sub")->calls, 1);
+	rv_free(&cpu);
+}
+
+static void test_stops(void)
+{
+	static const struct
+	{
+		uint32_t insn;
+		uint8_t len;
+		const char *error;
+	} cases[] = {
+		{0x02b50533, 4, "illegal instruction"},	   // mul a0, a0, a1: no M on the core
+		{0x00100813, 4, "register above x15"},	   // addi x16, x0, 1
+		{0x00002503, 4, "load outside memory"},	   // lw a0, 0(zero)
+		{0x00100073, 4, "ebreak"},				   // ebreak
+		{0x9002, 2, "ebreak"},					   // c.ebreak
+		{0xa001, 2, "too many steps"},			   // c.j .
+		{0x00053007, 4, "illegal instruction"},	   // fld
+	};
+	uint32_t ret = 0;
+
+	for (uint8_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		uint8_t code[4];
+		for (uint8_t j = 0; j < 4; j++)
+		{
+			code[j] = cases[i].insn >> (8 * j);
+		}
+		load(code, cases[i].len);
+		CHECK(!rv_call(&cpu, BASE, 0, &ret));
+		CHECK(cpu.error && strcmp(cpu.error, cases[i].error) == 0);
+		rv_free(&cpu);
+	}
+}
+
+// A linked image with the sum program at 0x20000 and a symbol table
+static void test_elf(void)
+{
+	static const char strtab[] = "\0twice\0entry\0__global_pointer$";
+	struct
+	{
+		uint8_t ident[16];
+		uint16_t type, machine;
+		uint32_t version, entry, phoff, shoff, flags;
+		uint16_t ehsize, phentsize, phnum, shentsize, shnum, shstrndx;
+	} header = {{0x7f, 'E', 'L', 'F', 1, 1, 1}, 2, 243, 1, 0x20000, 52, 0, 0, 52, 32, 1, 40, 3, 0};
+	uint32_t segment[8] = {1, 0, 0x20000, 0x20000, sizeof(sum_code), sizeof(sum_code) + 64, 5, 4};
+	struct
+	{
+		uint32_t name, value, size;
+		uint8_t info, other;
+		uint16_t shndx;
+	} symbols[4] = {
+		{0},
+		{1, 0x20000 + SUM_TWICE, 4, 0x12, 0, 1},
+		{7, 0x20000, 32, 0x12, 0, 1},
+		{13, 0x20800, 0, 0x10, 0, 1},
+	};
+	uint32_t sections[3][10] = {{0}};
+
+	uint32_t code_at = sizeof(header) + sizeof(segment);
+	uint32_t symtab_at = code_at + sizeof(sum_code);
+	uint32_t strtab_at = symtab_at + sizeof(symbols);
+	header.shoff = strtab_at + sizeof(strtab);
+	segment[1] = code_at;
+	uint32_t symtab[10] = {0, 2, 0, 0, symtab_at, sizeof(symbols), 2, 1, 4, 16};
+	uint32_t strings[10] = {0, 3, 0, 0, strtab_at, sizeof(strtab), 0, 0, 1, 0};
+	memcpy(sections[1], symtab, sizeof(symtab));
+	memcpy(sections[2], strings, sizeof(strings));
+
+	FILE *f = fopen("test_rvsim.elf", "wb");
+	CHECK(f != NULL);
+	if (!f)
+	{
+		return;
+	}
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(segment, sizeof(segment), 1, f);
+	fwrite(sum_code, sizeof(sum_code), 1, f);
+	fwrite(symbols, sizeof(symbols), 1, f);
+	fwrite(strtab, sizeof(strtab), 1, f);
+	fwrite(sections, sizeof(sections), 1, f);
+	fclose(f);
+
+	uint32_t ret = 0;
+	CHECK(rv_load_elf(&cpu, "test_rvsim.elf"));
+	remove("test_rvsim.elf");
+	CHECK_EQ(cpu.base, 0x20000);
+	CHECK_EQ(cpu.size, sizeof(sum_code) + 64 + RV_STACK_SIZE);
+	CHECK_EQ(cpu.x[3], 0x20800);
+	CHECK_EQ(cpu.func_count, 2);
+	RvFunc *entry = rv_find(&cpu, "entry");
+	CHECK(entry != NULL);
+	if (entry)
+	{
+		CHECK(rv_call(&cpu, entry->addr, 4, &ret));
+		CHECK_EQ(ret, 20);
+		CHECK_EQ(rv_find(&cpu, "twice")->calls, 1);
+	}
+	rv_free(&cpu);
+
+	CHECK(!rv_load_elf(&cpu, "test_rvsim.c"));
+	CHECK(!rv_load_elf(&cpu, "no such file"));
+}
+
+int main(void)
+{
+	test_sum();
+	test_base();
+	test_compressed();
+	test_stops();
+	test_elf();
+	return test_done("rvsim");
+}
@@ -0,0 +1,159 @@
+#include "test.h"
+#include "scheduler.h"
+#include "systime.h"
+
+// Simulated time: what the SysTick interrupt would do every millisecond
+static void advance(uint32_t ms)
+{
+	while (ms--)
+	{
+		systime_host_cnt += SYSTIME_TICKS_PER_MS;
+		systime_tick();
+	}
+}
+
+static uint32_t runs[2];
+static uint32_t run_at[2][64]; // millis() at each run
+static uint32_t busy_ms[2];	   // how long the next run takes
+
+static void record(uint8_t task)
+{
+	if (runs[task] < 64)
+	{
+		run_at[task][runs[task]] = millis();
+	}
+	runs[task]++;
+	advance(busy_ms[task]);
+}
+
+static void task0(void)
+{
+	record(0);
+}
+
+static void task1(void)
+{
+	record(1);
+}
+
+static void reset(void)
+{
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		runs[i] = 0;
+		busy_ms[i] = 0;
+	}
+}
+
+// Main loop for ms milliseconds, sched_run() once per tick
+static void loop(uint32_t ms)
+{
+	uint32_t end = millis() + ms;
+
+	while (!time_reached(end))
+	{
+		sched_run();
+		advance(1);
+	}
+}
+
+static void test_period(void)
+{
+	SchedTask tasks[] = {
+		{task0, 10, 10},
+		{task1, 25, 25},
+	};
+
+	reset();
+	uint32_t start = millis();
+	sched_init(tasks, 2);
+	loop(100);
+
+	// Released at init and then every period, on the period grid
+	CHECK_EQ(runs[0], 10);
+	CHECK_EQ(runs[1], 4);
+	for (uint8_t i = 0; i < 10; i++)
+	{
+		CHECK_EQ(run_at[0][i] - start, i * 10);
+	}
+	CHECK_EQ(sched_total_overruns(), 0);
+}
+
+static void test_deadline(void)
+{
+	SchedTask tasks[] = {
+		{task0, 10, 2},
+	};
+
+	reset();
+	busy_ms[0] = 5;
+	sched_init(tasks, 1);
+	loop(50);
+
+	// Every run finishes 5ms after release, past the 2ms deadline, but
+	// nothing is skipped
+	CHECK_EQ(runs[0], 5);
+	CHECK_EQ(tasks[0].overruns, 5);
+}
+
+static void test_skip(void)
+{
+	SchedTask tasks[] = {
+		{task0, 10, 10},
+	};
+
+	reset();
+	uint32_t start = millis();
+	sched_init(tasks, 1);
+	busy_ms[0] = 25;
+	sched_run();
+	busy_ms[0] = 0;
+	loop(50);
+
+	// The long run misses its deadline and the releases at 10 and 20 are
+	// skipped rather than run back to back. The next run stays on the grid
+	CHECK_EQ(tasks[0].overruns, 3);
+	CHECK_EQ(run_at[0][1] - start, 30);
+	CHECK_EQ(run_at[0][2] - start, 40);
+}
+
+static void test_latency(void)
+{
+	// A fast input task next to a slow display task, as in main.c
+	SchedTask tasks[] = {
+		{task0, 5, 10},
+		{task1, 50, 50},
+	};
+
+	reset();
+	busy_ms[1] = 8;
+	uint32_t start = millis();
+	sched_init(tasks, 2);
+	loop(200);
+
+	// Cooperative, so the input task waits out at most one display run
+	uint32_t worst = 0;
+	for (uint32_t i = 0; i < runs[0] && i < 64; i++)
+	{
+		uint32_t late = (run_at[0][i] - start) % 5;
+		if (late > worst)
+		{
+			worst = late;
+		}
+	}
+	CHECK(worst <= busy_ms[1]);
+	CHECK_EQ(tasks[0].overruns, 0);
+	CHECK_EQ(tasks[1].overruns, 0);
+	printf("scheduler: input task latency up to %u ms behind an 8 ms display task\n", worst);
+}
+
+int main(void)
+{
+	systime_init();
+
+	test_period();
+	test_deadline();
+	test_skip();
+	test_latency();
+	return test_done("scheduler");
+}
@@ -0,0 +1,80 @@
+#include "test.h"
+#include "systime.h"
+
+// Simulated SysTick: CNT runs on, the compare interrupt fires every ms
+static void advance_ticks(uint32_t ticks)
+{
+	static uint32_t to_interrupt = SYSTIME_TICKS_PER_MS;
+
+	while (ticks)
+	{
+		uint32_t step = ticks < to_interrupt ? ticks : to_interrupt;
+		systime_host_cnt += step;
+		ticks -= step;
+		to_interrupt -= step;
+		if (to_interrupt == 0)
+		{
+			systime_tick();
+			to_interrupt = SYSTIME_TICKS_PER_MS;
+		}
+	}
+}
+
+int main(void)
+{
+	// CNT wraps 3ms in
+	systime_host_cnt = UINT32_MAX - 3 * SYSTIME_TICKS_PER_MS + 1;
+	systime_init();
+	uint64_t ticks0 = systime_ticks();
+
+	CHECK_EQ(millis(), 0);
+	CHECK_EQ(micros(), 0);
+
+	// micros() counts between interrupts
+	advance_ticks(SYSTIME_TICKS_PER_US * 250);
+	CHECK_EQ(micros(), 250);
+	CHECK_EQ(millis(), 0);
+
+	// and stays monotonic, to the microsecond, across the CNT wrap
+	uint32_t last = micros();
+	for (uint32_t i = 0; i < 10000; i++)
+	{
+		advance_ticks(SYSTIME_TICKS_PER_US);
+		uint32_t now = micros();
+		CHECK_EQ(now - last, 1);
+		last = now;
+		if (test_failures)
+		{
+			break;
+		}
+	}
+	CHECK_EQ(millis(), 10);
+	CHECK_EQ(micros(), 10250);
+
+	// The 64 bit count carries past the 32 bit CNT
+	CHECK_EQ(systime_ticks() - ticks0, (uint64_t)SYSTIME_TICKS_PER_US * 10250);
+	CHECK(systime_ticks() > UINT32_MAX);
+
+	// elapsed_us() across the wrap of micros(), ~71.6 minutes in
+	uint32_t stamp = 0;
+	while (micros() < UINT32_MAX - 5000)
+	{
+		advance_ticks(SYSTIME_TICKS_PER_MS);
+		stamp = micros();
+	}
+	advance_ticks(SYSTIME_TICKS_PER_MS * 20);
+	CHECK(micros() < stamp);
+	CHECK_EQ(elapsed_us(stamp), 20000);
+
+	// Deadlines on either side of now, wrapping below zero and past the top
+	uint32_t now = millis();
+	CHECK(time_reached(now));
+	CHECK(time_reached(now - 5));
+	CHECK(!time_reached(now + 5));
+	CHECK(time_reached(now - UINT32_MAX / 4));
+	CHECK(!time_reached(now + UINT32_MAX / 4));
+	CHECK_EQ(elapsed_ms(now - 7), 7);
+	CHECK_EQ(elapsed_ms(now + UINT32_MAX), 1);
+
+	return test_done("systime");
+}
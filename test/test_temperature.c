@@ -0,0 +1,34 @@
+#include "test.h"
+#include "temperature.h"
+#include <math.h>
+
+int main(void)
+{
+	// Against double precision, the float code the shift/add math replaced.
+	// round() is half away from zero, like the integer code
+	for (int32_t c = -18000; c <= 18000; c++)
+	{
+		temp_q2_t f = temp_c_to_f(c);
+		CHECK_EQ(f, (int32_t)round(c * 9.0 / 5.0) + TEMP_Q2(32));
+		// F has the finer steps, so going back lands on c again
+		CHECK_EQ(temp_f_to_c(f), c);
+		if (test_failures)
+		{
+			break;
+		}
+	}
+	for (int32_t f = INT16_MIN; f <= INT16_MAX; f++)
+	{
+		CHECK_EQ(temp_f_to_c(f), (int32_t)round((f - TEMP_Q2(32)) * 5.0 / 9.0));
+		CHECK_EQ(temp_round(f), (int32_t)floor((f + 2) / 4.0));
+		if (test_failures)
+		{
+			break;
+		}
+	}
+
+	CHECK_EQ(temp_c_to_f(TEMP_Q2(100)), TEMP_Q2(212));
+	CHECK_EQ(temp_c_to_f(TEMP_Q2(-40)), TEMP_Q2(-40));
+	CHECK_EQ(temp_f_to_c(TEMP_Q2(32)), 0);
+	return test_done("temperature");
+}
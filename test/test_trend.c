@@ -0,0 +1,214 @@
+#include "test.h"
+#include "plant.h"
+#include "trend.h"
+#include "staging.h"
+#include <stdlib.h>
+
+// Least squares projection in doubles, for comparison
+static double reference(const uint32_t *time, const temp_q2_t *temp, uint32_t horizon_ms)
+{
+	uint32_t newest = time[TREND_SAMPLES - 1];
+	double su = 0, st = 0, suu = 0, sut = 0;
+
+	for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+	{
+		double u = (int32_t)(time[i] - newest);
+		su += u;
+		st += temp[i];
+		suu += u * u;
+		sut += u * temp[i];
+	}
+	double slope = (TREND_SAMPLES * sut - su * st) / (TREND_SAMPLES * suu - su * su);
+	return (st + slope * (TREND_SAMPLES * (double)horizon_ms - su)) / TREND_SAMPLES;
+}
+
+static void test_fit(void)
+{
+	Trend trend;
+	temp_q2_t projected;
+
+	// Not before the window is full
+	trend_reset(&trend);
+	for (uint8_t i = 0; i < TREND_SAMPLES - 1; i++)
+	{
+		trend_add(&trend, i * 1000, TEMP_Q2(40));
+		CHECK(!trend_project(&trend, 10000, &projected));
+	}
+
+	// Flat stays flat
+	trend_add(&trend, 7000, TEMP_Q2(40));
+	CHECK(trend_project(&trend, 60000, &projected));
+	CHECK_EQ(projected, TEMP_Q2(40));
+
+	// A ramp of 1 quarter degree per second, uneven spacing and across the
+	// wrap of millis()
+	static const uint16_t gaps[] = {900, 1100, 1000, 700, 1300, 1000, 1000};
+	uint32_t t = UINT32_MAX - 4000;
+	trend_reset(&trend);
+	for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+	{
+		trend_add(&trend, t, TEMP_Q2(40) + (int32_t)(t - (UINT32_MAX - 4000)) / 1000);
+		if (i < TREND_SAMPLES - 1)
+		{
+			t += gaps[i];
+		}
+	}
+	CHECK(trend_project(&trend, 30000, &projected));
+	CHECK(abs(projected - (TEMP_Q2(40) + 8 + 30)) <= 1);
+
+	// A window older than TREND_SPAN_MAX_MS gives no projection
+	trend_reset(&trend);
+	for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+	{
+		trend_add(&trend, i * 10000, TEMP_Q2(40));
+	}
+	CHECK(!trend_project(&trend, 1000, &projected));
+
+	// Projections past the temp_q2_t range saturate, either way
+	trend_reset(&trend);
+	for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+	{
+		trend_add(&trend, i * 100, TEMP_Q2(40) - i * 400);
+	}
+	CHECK(trend_project(&trend, 1 << 20, &projected));
+	CHECK_EQ(projected, INT16_MIN);
+	trend_reset(&trend);
+	for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+	{
+		trend_add(&trend, i * 100, TEMP_Q2(40) + i * 400);
+	}
+	CHECK(trend_project(&trend, 1 << 20, &projected));
+	CHECK_EQ(projected, INT16_MAX);
+
+	// All samples at the same time have no slope
+	trend_reset(&trend);
+	for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+	{
+		trend_add(&trend, 5000, TEMP_Q2(40) + i);
+	}
+	CHECK(!trend_project(&trend, 1000, &projected));
+
+	// Random windows against doubles, up to the furthest lookahead
+	srand(1);
+	for (uint32_t n = 0; n < 100000; n++)
+	{
+		uint32_t time[TREND_SAMPLES];
+		temp_q2_t temp[TREND_SAMPLES];
+		t = rand() * 2u;
+		trend_reset(&trend);
+		for (uint8_t i = 0; i < TREND_SAMPLES; i++)
+		{
+			t += 200 + rand() % 2000;
+			time[i] = t;
+			temp[i] = TEMP_Q2(20) + rand() % TEMP_Q2(100);
+			trend_add(&trend, time[i], temp[i]);
+		}
+		uint32_t horizon = (rand() % 256) * 1000;
+		double expect = reference(time, temp, horizon);
+		CHECK(trend_project(&trend, horizon, &projected));
+		if (expect > INT16_MAX)
+		{
+			CHECK_EQ(projected, INT16_MAX);
+		}
+		else if (expect < INT16_MIN)
+		{
+			CHECK_EQ(projected, INT16_MIN);
+		}
+		else
+		{
+			CHECK(fabs(projected - expect) <= 0.5 + 1e-9);
+		}
+		if (test_failures)
+		{
+			break;
+		}
+	}
+}
+
+// Relay fan as fanTask runs it: a stage on sensor 1, 1C hysteresis, 30s
+// dwell, switched on the reading or the projection, whichever is higher
+static Plant plant;
+static Trend trend;
+static uint32_t lookahead_ms;
+static bool fan_on;
+
+static void fan_output(uint8_t channel, bool on)
+{
+	(void)channel;
+	fan_on = on;
+}
+
+static bool stage_temp(uint8_t sensor, temp_q2_t *temp)
+{
+	temp_q2_t projected;
+
+	(void)sensor;
+	*temp = plant_read(&plant);
+	if (lookahead_ms && trend_project(&trend, lookahead_ms, &projected) && projected > *temp)
+	{
+		*temp = projected;
+	}
+	return true;
+}
+
+// Peak past the setpoint, on the sensor as trackOvershoot() sees it, when
+// the box heats up from 30C with heat C/s of load
+static double overshoot(uint32_t lookahead_s, double heat, double setpoint)
+{
+	Stage stage = {.sensor = 0, .on = TEMP_Q2(setpoint), .off = TEMP_Q2(setpoint) - TEMP_Q2(1),
+				   .dwell_ms = 30000, .output = fan_output, .enabled = true};
+	double peak = 0;
+
+	plant_init(&plant, 30);
+	plant.heat = heat;
+	trend_reset(&trend);
+	lookahead_ms = lookahead_s * 1000;
+	fan_on = false;
+	staging_init(&stage, 1, 0);
+	for (uint32_t t = 0; t < 7200; t++)
+	{
+		trend_add(&trend, t * 1000, plant_read(&plant));
+		staging_update(&stage, 1, stage_temp, t * 1000);
+		plant_step(&plant, fan_on ? 1 : 0);
+
+		double over = plant_read(&plant) / 4.0 - setpoint;
+		if (over > peak)
+		{
+			peak = over;
+		}
+		else if (over <= 0 && peak > 0)
+		{
+			break;
+		}
+	}
+	return peak;
+}
+
+static void test_overshoot(void)
+{
+	static const uint8_t lookaheads[] = {0, 5, 10, 20};
+	static const double heats[] = {0.05, 0.08, 0.11}; // full fan holds up to 0.125
+
+	// The 10s sensor lag of the plant makes the fan start late, looking
+	// ahead by about that much should make up for it
+	for (uint8_t h = 0; h < sizeof(heats) / sizeof(heats[0]); h++)
+	{
+		double peak[sizeof(lookaheads)];
+
+		printf("trend: load %.2fC/s, overshoot", heats[h]);
+		for (uint8_t i = 0; i < sizeof(lookaheads); i++)
+		{
+			peak[i] = overshoot(lookaheads[i], heats[h], 40);
+			printf(" %.2fC at %us%s", peak[i], lookaheads[i], i + 1u < sizeof(lookaheads) ? "," : "\n");
+		}
+		CHECK(peak[0] > 0);
+		CHECK(peak[2] <= peak[0] / 2);
+	}
+}
+
+int main(void)
+{
+	test_fit();
+	test_overshoot();
+	return test_done("trend");
+}